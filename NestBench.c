@@ -0,0 +1,602 @@
+// NestBench.c
+// ----------------------------------------------------------------------------
+// Purpose: Benchmarks the reduction engine of NestIndex (libnestindex, see
+//          NestEngine.c) and generates corpora of double occurrence words to
+//          run it on. Each benchmark prints one JSON object per line, so runs
+//          of two builds can be compared by a script.
+// ----------------------------------------------------------------------------
+// Command Line Arguments:
+// (none):        Runs the benchmark suite: for each corpus of the suite,
+//                times get_NI, step, get_repeat_return_words, copy_words and
+//                get_isomorphisms on its words, then the -t and -c modes of
+//                the NestIndex binary end to end.
+// --quick:       Runs each benchmark for a fraction of the usual time.
+// --binary path: NestIndex binary timed end to end (default ./NestIndex).
+//                "" skips end-to-end benchmarks.
+// --generate n count: Prints count random DOWs with n letters (n may be a
+//                range lo-hi) to stdout, one per line, in relabeled form.
+//                Shaped by the options below.
+// Options of --generate:
+// --seed s:      Seed of the generator (default 1). Same seed, same corpus.
+// --subwords f:  Share (0 to 1) of letters placed in repeat words
+//                (123..123..) and return words (123..321..) of 1 to 5
+//                letters, which step removes at once (default 0).
+// --nesting f:   Share (0 to 1) of the other letters whose occurrences wrap
+//                a closed part of the word, i.e., one where every letter has
+//                both occurrences, giving nested words; the rest are placed
+//                at random (default 0).
+// --adversarial: Only words without maximal subwords, so every step removes
+//                single letters and frontiers are as wide as possible.
+// ----------------------------------------------------------------------------
+// Output records have the fields
+//   "benchmark", "corpus", "words" and "seconds", and by benchmark:
+//   get_NI, step, get_repeat_return_words, copy_words, get_isomorphisms:
+//                "calls" and "ns_per_call" (copy_words: "words_copied" and
+//                "ns_per_word")
+//   end_to_end_t, end_to_end_c: "runs" and "words_per_second"
+// ----------------------------------------------------------------------------
+// To compile and run, run:
+// >> make bench
+// ----------------------------------------------------------------------------
+
+
+// The engine, linked from libnestindex. Its kernels are timed one by one, so
+// this in-tree benchmark uses the internal interface, not nestindex.h
+#include "NestEngine.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define BENCH_SECONDS 0.5	// Least time spent on each benchmark
+#define GENERATE_TRIES 1000	// Words tried per adversarial word
+
+// Corpus types
+// A corpus spec tells the generator the shape of the words of a corpus.
+typedef struct corpus_spec {
+    const char * name;
+    int min_letters;
+    int max_letters;
+    int count;			// Number of words
+    double subwords;		// Share of letters in repeat/return words
+    double nesting;		// Share of other letters wrapping closed parts
+    short adversarial;		// Only words without maximal subwords
+} corpus_spec;
+
+// A corpus holds generated words, each alloc'd with malloc.
+typedef struct corpus {
+    unsigned short ** words;
+    int * sizes;
+    int count;
+} corpus;
+
+static volatile int bench_sink;	// Keeps benchmarked calls from being dropped
+
+// Corpora of the suite, from cheap to costly words
+static const corpus_spec suite[] = {
+    {"random-8", 8, 8, 2000, 0, 0, 0},
+    {"random-12", 12, 12, 200, 0, 0, 0},
+    {"nested-14", 14, 14, 200, 0.2, 0.8, 0},
+    {"subwords-24", 24, 24, 200, 0.6, 0.3, 0},
+    {"adversarial-11", 11, 11, 100, 0, 0, 1},
+    {"long-200", 200, 200, 20, 0.9, 1, 0},
+};
+
+
+// Function templates
+unsigned long long next_random(unsigned long long *);
+int random_below(unsigned long long *, int);
+int generate_word(const corpus_spec *, unsigned long long *, unsigned short *);
+void insert_letter(unsigned short *, int *, unsigned char *, int,
+		   unsigned short);
+int random_boundary(unsigned char *, int, unsigned long long *);
+int closed_end(unsigned short *, int, unsigned char *, int,
+	       unsigned long long *);
+short make_corpus(const corpus_spec *, unsigned long long, corpus *);
+void free_corpus(corpus *);
+double now(void);
+void bench_get_NI(const corpus_spec *, corpus *, double);
+void bench_step(const corpus_spec *, corpus *, double);
+void bench_subwords(const corpus_spec *, corpus *, double);
+void bench_copy_words(const corpus_spec *, corpus *, double);
+void bench_isomorphisms(const corpus_spec *, corpus *, double);
+void bench_end_to_end(const corpus_spec *, corpus *, const char *, double);
+void print_calls(const char *, const corpus_spec *, corpus *, double,
+		 unsigned long long);
+void bench_usage(void);
+void write_word(FILE *, unsigned short *, int);
+
+
+int main(int argc, char * argv[])
+{
+    corpus_spec spec = {"generated", 0, 0, 0, 0, 0, 0};
+    corpus words;
+    unsigned long long seed = 1;
+    const char * binary = "./NestIndex";
+    double seconds = BENCH_SECONDS;
+    short generate = 0;
+    char * end = NULL;
+    int i = 0;
+
+    for(i = 1; i < argc; i++){
+	if(!strcmp(argv[i], "--quick")) seconds = BENCH_SECONDS/10;
+	else if(!strcmp(argv[i], "--binary") && i + 1 < argc)
+	    binary = argv[++i];
+	else if(!strcmp(argv[i], "--generate") && i + 2 < argc){
+	    generate = 1;
+	    spec.min_letters = (int) strtol(argv[++i], &end, 10);
+	    spec.max_letters = spec.min_letters;
+	    if(*end == '-') spec.max_letters = (int) strtol(end + 1, &end, 10);
+	    if(*end != '\0') bench_usage();
+	    spec.count = (int) strtol(argv[++i], &end, 10);
+	    if(*end != '\0') bench_usage();
+	}
+	else if(!strcmp(argv[i], "--seed") && i + 1 < argc)
+	    seed = strtoull(argv[++i], NULL, 10);
+	else if(!strcmp(argv[i], "--subwords") && i + 1 < argc)
+	    spec.subwords = atof(argv[++i]);
+	else if(!strcmp(argv[i], "--nesting") && i + 1 < argc)
+	    spec.nesting = atof(argv[++i]);
+	else if(!strcmp(argv[i], "--adversarial")) spec.adversarial = 1;
+	else bench_usage();
+    }
+
+    if(generate){
+	if(spec.min_letters < 1 || spec.max_letters < spec.min_letters ||
+	   spec.max_letters > USHRT_MAX/2 || spec.count < 0 ||
+	   spec.subwords < 0 || spec.subwords > 1 ||
+	   spec.nesting < 0 || spec.nesting > 1)
+	    bench_usage();
+	if(!make_corpus(&spec, seed, &words)){
+	    printf("Memory could not be alloc'd for corpus\r\n");
+	    return 1;
+	}
+	for(i = 0; i < words.count; i++)
+	    write_word(stdout, words.words[i], words.sizes[i]);
+	free_corpus(&words);
+	return 0;
+    }
+
+    printf("{\"benchmark\": \"build\", \"packed_letters\": %d, "
+	   "\"simd\": %d, \"memo_small_size\": %d}\n", PACKED_LETTERS,
+	   SIMD_X86, MEMO_SMALL_SIZE);
+    for(i = 0; i < (int) (sizeof(suite)/sizeof(suite[0])); i++){
+	if(!make_corpus(&suite[i], seed, &words)){
+	    printf("Memory could not be alloc'd for corpus\r\n");
+	    return 1;
+	}
+	bench_get_NI(&suite[i], &words, seconds);
+	bench_step(&suite[i], &words, seconds);
+	bench_subwords(&suite[i], &words, seconds);
+	bench_copy_words(&suite[i], &words, seconds);
+	bench_isomorphisms(&suite[i], &words, seconds);
+	if(*binary != '\0')
+	    bench_end_to_end(&suite[i], &words, binary, seconds);
+	free_corpus(&words);
+	fflush(stdout);
+    }
+    return 0;
+}
+
+
+//// next_random function
+// Given the state of a xorshift64* generator, advances it and returns the
+// next random number. State must not be 0.
+unsigned long long next_random(unsigned long long * state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+//// random_below function
+// Given a generator state and n > 0, returns a random int in 0:n.
+int random_below(unsigned long long * state, int n)
+{
+    return (int) ((next_random(state) >> 11) % (unsigned long long) n);
+}
+
+//// generate_word function
+// Given a corpus spec, a generator state and room for 2*max_letters letters,
+// stores a random relabeled DOW of the shape of spec in word and returns its
+// size. Repeat and return words are kept whole by only inserting letters at
+// boundaries (cuts[i] set if a letter may go before position i).
+int generate_word(const corpus_spec * spec, unsigned long long * state,
+		  unsigned short * word)
+{
+    int letters = spec->min_letters +
+	random_below(state, spec->max_letters - spec->min_letters + 1);
+    int in_subwords = (int) (spec->subwords*letters + 0.5);
+    unsigned char cuts[2*letters + 1];
+    unsigned short next_ltr = 1;
+    int size = 0, len = 0, at = 0, to = 0, i = 0;
+    short repeat = 0;		// Block is repeat word, else return word
+
+    cuts[0] = 1;
+    // Repeat and return words go in at random cuts as blocks
+    while(next_ltr <= in_subwords){
+	len = 1 + random_below(state, 5);
+	if(len > in_subwords - next_ltr + 1) len = in_subwords - next_ltr + 1;
+	repeat = random_below(state, 2);
+	at = random_boundary(cuts, size, state);
+	memmove(word + at + 2*len, word + at, sizeof(unsigned short)*(size - at));
+	memmove(cuts + at + 2*len, cuts + at, size - at + 1);
+	for(i = 0; i < len; i++){
+	    word[at + i] = next_ltr + i;
+	    word[at + len + i] = (repeat)? next_ltr + i: next_ltr + len - 1 - i;
+	}
+	memset(cuts + at + 1, 0, 2*len - 1);
+	cuts[at] = cuts[at + 2*len] = 1;
+	size += 2*len;
+	next_ltr += len;
+    }
+    // Other letters wrap a closed part or go anywhere
+    for(; next_ltr <= letters; next_ltr++){
+	at = random_boundary(cuts, size, state);
+	if(random_below(state, 1000) < (int) (spec->nesting*1000))
+	    to = closed_end(word, size, cuts, at, state);
+	else to = random_boundary(cuts, size, state);
+	if(to < at){
+	    i = at;
+	    at = to;
+	    to = i;
+	}
+	insert_letter(word, &size, cuts, to, next_ltr);
+	insert_letter(word, &size, cuts, at, next_ltr);
+    }
+    relabel(word, size);
+    return size;
+}
+
+//// insert_letter function
+// Given a word, a pointer to its size, its cuts, a cut at and a letter,
+// inserts letter at position at, with cuts on both of its sides.
+void insert_letter(unsigned short * word, int * size, unsigned char * cuts,
+		   int at, unsigned short letter)
+{
+    memmove(word + at + 1, word + at, sizeof(unsigned short)*(*size - at));
+    memmove(cuts + at + 1, cuts + at, *size - at + 1);
+    word[at] = letter;
+    cuts[at] = cuts[at + 1] = 1;
+    *size += 1;
+}
+
+//// random_boundary function
+// Given cuts of a word, its size and a generator state, returns a random
+// position in 0:size+1 where a cut is.
+int random_boundary(unsigned char * cuts, int size, unsigned long long * state)
+{
+    int places[size + 1];
+    int count = 0, i = 0;
+
+    for(i = 0; i <= size; i++)
+	if(cuts[i]) places[count++] = i;
+    return places[random_below(state, count)];
+}
+
+//// closed_end function
+// Given a word, its size, cuts, a cut at and a generator state, returns a
+// random cut to such that every letter between at and to has both of its
+// occurrences there. Searches right of at; at itself always qualifies.
+int closed_end(unsigned short * word, int size, unsigned char * cuts, int at,
+	       unsigned long long * state)
+{
+    int places[size + 1];
+    int partners[size];
+    letter_index index = {partners, NULL};
+    int count = 0, open = 0, i = 0;
+
+    index_word(word, size, &index);
+    places[count++] = at;
+    for(i = at; i < size; i++){
+	if(partners[i] > i) open++;
+	else if(partners[i] < at) break;	// Other occurrence is left of at
+	else open--;
+	if(open == 0 && cuts[i + 1]) places[count++] = i + 1;
+    }
+    return places[random_below(state, count)];
+}
+
+//// make_corpus function
+// Given a corpus spec, a seed and a corpus, fills corpus with count words of
+// the shape of spec. Returns 0 if memory could not be alloc'd, else 1.
+short make_corpus(const corpus_spec * spec, unsigned long long seed,
+		  corpus * words)
+{
+    unsigned long long state = seed*0x9e3779b97f4a7c15ull + 1;
+    unsigned short * reduction_list[spec->max_letters + 1];
+    int i = 0, tries = 0;
+
+    words->count = 0;
+    words->words = (unsigned short **) malloc(sizeof(unsigned short *)*
+					      (spec->count + 1));
+    words->sizes = (int *) malloc(sizeof(int)*(spec->count + 1));
+    if(words->words == NULL || words->sizes == NULL){
+	free_corpus(words);
+	return 0;
+    }
+    for(i = 0; i < spec->count; i++){
+	words->words[i] = (unsigned short *)
+	    malloc(sizeof(unsigned short)*2*spec->max_letters);
+	if(words->words[i] == NULL){
+	    free_corpus(words);
+	    return 0;
+	}
+	words->count++;
+	for(tries = 0; tries < GENERATE_TRIES; tries++){
+	    words->sizes[i] = generate_word(spec, &state, words->words[i]);
+	    if(!spec->adversarial || words->sizes[i] <= 2 ||
+	       get_repeat_return_words(words->words[i], words->sizes[i],
+				       reduction_list) == 0)
+		break;
+	}
+    }
+    return 1;
+}
+
+//// free_corpus function
+// Frees the words of a corpus.
+void free_corpus(corpus * words)
+{
+    int i = 0;
+
+    for(i = 0; i < words->count; i++) free(words->words[i]);
+    free(words->words);
+    free(words->sizes);
+    words->words = NULL;
+    words->sizes = NULL;
+    words->count = 0;
+}
+
+//// now function
+// Returns seconds of a monotonic clock.
+double now(void)
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec/1e9;
+}
+
+//// print_calls function
+// Prints the record of a benchmark of calls: its name, spec and corpus, the
+// time it took and the number of calls made.
+void print_calls(const char * name, const corpus_spec * spec, corpus * words,
+		 double seconds, unsigned long long calls)
+{
+    printf("{\"benchmark\": \"%s\", \"corpus\": \"%s\", \"words\": %d, "
+	   "\"seconds\": %.6f, \"calls\": %llu, \"ns_per_call\": %.1f}\n",
+	   name, spec->name, words->count, seconds, calls,
+	   (calls > 0)? seconds*1e9/calls: 0.0);
+}
+
+//// bench_get_NI function
+// Times get_NI without a memo table over the words of corpus, as many times
+// as fit in seconds (at least once).
+void bench_get_NI(const corpus_spec * spec, corpus * words, double seconds)
+{
+    unsigned long long calls = 0;
+    double start = now(), elapsed = 0;
+    int i = 0;
+
+    do{
+	for(i = 0; i < words->count; i++){
+	    if(get_NI(words->words[i], words->sizes[i], NULL) < 0){
+		printf("Memory could not be alloc'd for get_NI\r\n");
+		exit(1);
+	    }
+	}
+	calls += words->count;
+	elapsed = now() - start;
+    } while(elapsed < seconds);
+    print_calls("get_NI", spec, words, elapsed, calls);
+}
+
+//// bench_step function
+// Times one step of each word of corpus, children going to an arena that is
+// reset after each word.
+void bench_step(const corpus_spec * spec, corpus * words, double seconds)
+{
+    unsigned short * children[spec->max_letters + 1];
+    int sizes[spec->max_letters + 1];
+    word_arena arena;
+    unsigned long long calls = 0;
+    double start = now(), elapsed = 0;
+    int i = 0;
+
+    arena_init(&arena);
+    do{
+	for(i = 0; i < words->count; i++){
+	    if(step(words->words[i], words->sizes[i], children, sizes,
+		    &arena, NULL) < 0){
+		printf("Memory could not be alloc'd for step\r\n");
+		exit(1);
+	    }
+	    arena_reset(&arena);
+	}
+	calls += words->count;
+	elapsed = now() - start;
+    } while(elapsed < seconds);
+    arena_release(&arena);
+    print_calls("step", spec, words, elapsed, calls);
+}
+
+//// bench_subwords function
+// Times get_repeat_return_words over the words of corpus.
+void bench_subwords(const corpus_spec * spec, corpus * words, double seconds)
+{
+    unsigned short * reduction_list[spec->max_letters + 1];
+    unsigned long long calls = 0;
+    double start = now(), elapsed = 0;
+    int i = 0;
+
+    do{
+	for(i = 0; i < words->count; i++)
+	    bench_sink = get_repeat_return_words(words->words[i],
+					     words->sizes[i], reduction_list);
+	calls += words->count;
+	elapsed = now() - start;
+    } while(elapsed < seconds);
+    print_calls("get_repeat_return_words", spec, words, elapsed, calls);
+}
+
+//// bench_copy_words function
+// Times copy_words on the level made of the children of every word of
+// corpus, each child twice, as a level of get_NI has many duplicates.
+void bench_copy_words(const corpus_spec * spec, corpus * words,
+		      double seconds)
+{
+    int room = words->count*(spec->max_letters + 1)*2;
+    unsigned short ** level = malloc(sizeof(unsigned short *)*room);
+    unsigned short ** dest = malloc(sizeof(unsigned short *)*room);
+    int * level_sizes = malloc(sizeof(int)*room);
+    int * dest_sizes = malloc(sizeof(int)*room);
+    unsigned long long copied = 0;
+    word_arena arena;
+    double start = 0, elapsed = 0;
+    int count = 0, children = 0, i = 0;
+
+    arena_init(&arena);
+    if(level == NULL || dest == NULL || level_sizes == NULL ||
+       dest_sizes == NULL){
+	printf("Memory could not be alloc'd for copy_words\r\n");
+	exit(1);
+    }
+    for(i = 0; i < words->count; i++){
+	children = step(words->words[i], words->sizes[i], level + count,
+			level_sizes + count, &arena, NULL);
+	if(children < 0){
+	    printf("Memory could not be alloc'd for step\r\n");
+	    exit(1);
+	}
+	memcpy(level + count + children, level + count,
+	       sizeof(unsigned short *)*children);
+	memcpy(level_sizes + count + children, level_sizes + count,
+	       sizeof(int)*children);
+	count += 2*children;
+    }
+    start = now();
+    do{
+	children = count;
+	if(!copy_words(dest, dest_sizes, level, level_sizes, &children)){
+	    printf("Memory could not be alloc'd for copy_words\r\n");
+	    exit(1);
+	}
+	copied += count;
+	elapsed = now() - start;
+    } while(elapsed < seconds && count > 0);
+    printf("{\"benchmark\": \"copy_words\", \"corpus\": \"%s\", \"words\": %d, "
+	   "\"seconds\": %.6f, \"words_copied\": %llu, \"ns_per_word\": %.1f}\n",
+	   spec->name, words->count, elapsed, copied,
+	   (copied > 0)? elapsed*1e9/copied: 0.0);
+    arena_release(&arena);
+    free(level);
+    free(dest);
+    free(level_sizes);
+    free(dest_sizes);
+}
+
+//// bench_isomorphisms function
+// Times get_isomorphisms over the words of corpus, each writing its words
+// into a buffer with room for those of the largest word.
+void bench_isomorphisms(const corpus_spec * spec, corpus * words,
+			double seconds)
+{
+    unsigned short * isomorphisms = NULL;
+    unsigned long long calls = 0;
+    double start = 0, elapsed = 0;
+    int max_size = 0, i = 0;
+
+    for(i = 0; i < words->count; i++)
+	if(words->sizes[i] > max_size) max_size = words->sizes[i];
+    isomorphisms = (unsigned short *) \
+	malloc(sizeof(unsigned short)*(NI_ISOMORPHISMS_ROOM(max_size) + 1));
+    if(isomorphisms == NULL){
+	printf("Memory could not be alloc'd for get_isomorphisms\r\n");
+	exit(1);
+    }
+    start = now();
+    do{
+	for(i = 0; i < words->count; i++)
+	    bench_sink = get_isomorphisms(words->words[i], words->sizes[i],
+					  isomorphisms);
+	calls += words->count;
+	elapsed = now() - start;
+    } while(elapsed < seconds);
+    print_calls("get_isomorphisms", spec, words, elapsed, calls);
+    free(isomorphisms);
+}
+
+//// bench_end_to_end function
+// Writes corpus to a temporary file and times binary on it with -t and with
+// -c, output going to /dev/null, as many runs as fit in seconds.
+void bench_end_to_end(const corpus_spec * spec, corpus * words,
+		      const char * binary, double seconds)
+{
+    static const char * modes[] = {"-t", "-c"};
+    static const char * names[] = {"end_to_end_t", "end_to_end_c"};
+    char path[] = "/tmp/nestbench_XXXXXX";
+    FILE * file = NULL;
+    double start = 0, elapsed = 0;
+    int runs = 0, status = 0, fd = 0, mode = 0, i = 0;
+    pid_t pid;
+
+    fd = mkstemp(path);
+    if(fd == -1 || (file = fdopen(fd, "w")) == NULL){
+	printf("Temporary corpus file could not be opened\r\n");
+	exit(1);
+    }
+    for(i = 0; i < words->count; i++)
+	write_word(file, words->words[i], words->sizes[i]);
+    fclose(file);
+
+    for(mode = 0; mode < 2; mode++){
+	runs = 0;
+	start = now();
+	do{
+	    pid = fork();
+	    if(pid == 0){
+		fd = open("/dev/null", O_WRONLY);
+		if(fd != -1) dup2(fd, STDOUT_FILENO);
+		execl(binary, binary, modes[mode], path, (char *) NULL);
+		_exit(127);
+	    }
+	    if(pid == -1 || waitpid(pid, &status, 0) == -1 ||
+	       !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+		printf("%s %s %s failed\r\n", binary, modes[mode], path);
+		unlink(path);
+		exit(1);
+	    }
+	    runs++;
+	    elapsed = now() - start;
+	} while(elapsed < seconds);
+	printf("{\"benchmark\": \"%s\", \"corpus\": \"%s\", \"words\": %d, "
+	       "\"seconds\": %.6f, \"runs\": %d, \"words_per_second\": %.1f}\n",
+	       names[mode], spec->name, words->count, elapsed, runs,
+	       words->count*runs/elapsed);
+    }
+    unlink(path);
+}
+
+//// bench_usage function
+// Prints a usage message for NestBench and exits.
+void bench_usage(void)
+{
+    printf("Usage: NestBench [--quick] [--binary path]\r\n"
+	   "       NestBench --generate n[-m] count [--seed s] "
+	   "[--subwords f] [--nesting f] [--adversarial]\r\n");
+    exit(1);
+}
+
+//// write_word function
+// Given a file and a word with its size, writes word the way NestIndex reads
+// it, with commas if it has 20 or more letters, followed by \r\n.
+void write_word(FILE * file, unsigned short * word, int size)
+{
+    int i = 0;
+
+    for(i = 0; i < size; i++)
+	fprintf(file, (size >= 20 && i < size - 1)? "%u,": "%u", word[i]);
+    fprintf(file, "\r\n");
+}
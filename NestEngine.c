@@ -0,0 +1,3425 @@
+// NestEngine.c
+// ----------------------------------------------------------------------------
+// Purpose: The reduction engine of NestIndex, built as libnestindex (see
+//          nestindex.h). Computes the Nesting Index of double occurrence
+//          words. For a formal definition of the Nesting Index see
+//          documentation in: http://arxiv.org/abs/1311.3543 or
+//          http://scholarcommons.usf.edu/etd/4979/.
+// ----------------------------------------------------------------------------
+// Functions of this file never exit or print. Those of nestindex.h check
+// their arguments and return error codes; the rest take arguments as given.
+// ----------------------------------------------------------------------------
+// To build libnestindex.a and libnestindex.so, run:
+// >> make lib
+// ----------------------------------------------------------------------------
+
+
+#include <assert.h>
+#include <ctype.h>	//contains ispunct and isdigit functions
+// POSIX libs, for NI databases
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "NestEngine.h"
+
+#define LETTER_DELIMITERS ",-.!#$%&'*+/"
+
+
+// Context type
+// A context has a memo table for each of its jobs, each with a lock. A call
+// takes the tables whose locks it gets without waiting, so calls sharing a
+// context never block one another; a call that gets none runs without memo.
+struct ni_context {
+    ni_options options;
+    ni_query query;
+    memo_table ** memos;	// One per job, NULL if off or not alloc'd
+    pthread_mutex_t * locks;	// One per memo table
+    shared_memo * shared;	// Behind memo tables, NULL unless several jobs
+    ni_db * db;			// NULL if no database is open
+};
+
+static _Atomic(diff_function) diff_kernel;	// Set by select_diff_kernel
+
+// Query of get_NI and get_NI_parallel: no bound and no cancel function
+static const ni_query full_query = {NI_UNBOUNDED, ENGINE_BFS,
+				    (size_t) SEARCH_TABLE_MB << 20, NULL, NULL,
+				    0, 0, 0, 0};
+
+
+// Function templates
+int acquire_memos(ni_context *, int *, int);
+void release_memos(ni_context *, int *, int);
+
+
+//// ni_default_options function
+// Given options, sets them to the defaults of a context.
+void ni_default_options(ni_options * options)
+{
+    options->memo_budget = (size_t) MEMO_DEFAULT_MB << 20;
+    options->jobs = 1;
+    options->bound = NI_UNBOUNDED;
+    options->engine = ENGINE_BFS;
+    options->table_budget = (size_t) SEARCH_TABLE_MB << 20;
+    options->cancel = NULL;
+    options->cancel_arg = NULL;
+    options->time_limit = 0;
+    options->frontier_limit = 0;
+    options->memory_limit = 0;
+}
+
+//// ni_context_create function
+// Given options (NULL for defaults), returns a new context with a memo table
+// for each job, splitting options->memo_budget among them, or NULL if
+// options are not valid or memory could not be alloc'd. With several jobs,
+// the memo tables only get 1/MEMO_PRIVATE_SHARE of the budget and a shared
+// memo behind them gets the rest, if budget is at least
+// SHARED_MEMO_MIN_BYTES. Memo tables that could not be alloc'd are
+// left NULL, as is a shared memo.
+ni_context * ni_context_create(const ni_options * options)
+{
+    ni_context * context = NULL;
+    ni_options defaults;
+    size_t budget = 0;
+    int i = 0;
+
+    if(options == NULL){
+	ni_default_options(&defaults);
+	options = &defaults;
+    }
+    if(options->jobs < 1 || options->jobs > 4096 || options->bound < 0 ||
+       (options->engine != ENGINE_BFS && options->engine != ENGINE_DFS) ||
+       !(options->time_limit >= 0))
+	return NULL;
+    context = (ni_context *) malloc(sizeof(ni_context));
+    if(context == NULL) return NULL;
+    context->options = *options;
+    context->shared = NULL;
+    context->db = NULL;
+    context->query.bound = options->bound;
+    context->query.engine = options->engine;
+    context->query.table_budget = options->table_budget;
+    context->query.cancel = options->cancel;
+    context->query.cancel_arg = options->cancel_arg;
+    context->query.time_limit = options->time_limit;
+    context->query.frontier_limit = options->frontier_limit;
+    context->query.memory_limit = options->memory_limit;
+    context->query.deadline = 0;
+    context->memos = (memo_table **) calloc(options->jobs,
+					    sizeof(memo_table *));
+    context->locks = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t)*
+						options->jobs);
+    if(context->memos == NULL || context->locks == NULL){
+	free(context->memos);
+	free(context->locks);
+	free(context);
+	return NULL;
+    }
+    budget = options->memo_budget;
+    if(options->jobs > 1 && budget >= SHARED_MEMO_MIN_BYTES){
+	context->shared = shared_memo_create(budget - budget/MEMO_PRIVATE_SHARE);
+	if(context->shared != NULL) budget /= MEMO_PRIVATE_SHARE;
+    }
+    for(i = 0; i < options->jobs; i++){
+	pthread_mutex_init(&context->locks[i], NULL);
+	if(options->memo_budget > 0)
+	    context->memos[i] = memo_create(budget/options->jobs);
+	if(context->memos[i] != NULL)
+	    context->memos[i]->shared = context->shared;
+    }
+    return context;
+}
+
+//// ni_context_free function
+// Given a context (may be NULL), frees it and its memo tables.
+void ni_context_free(ni_context * context)
+{
+    int i = 0;
+
+    if(context == NULL) return;
+    for(i = 0; i < context->options.jobs; i++){
+	memo_free(context->memos[i]);
+	pthread_mutex_destroy(&context->locks[i]);
+    }
+    shared_memo_free(context->shared);
+    db_close(context->db);
+    free(context->memos);
+    free(context->locks);
+    free(context);
+}
+
+//// ni_context_open_db function
+// Given a context, the path of an NI database and read_only, opens database
+// (see db_open) and puts it behind each memo table of context. Jobs without
+// a memo table get one with no budget, which only fronts database. Returns
+// NI_OK or an error code, in which case context is left without database.
+int ni_context_open_db(ni_context * context, const char * path,
+		       int read_only)
+{
+    int i = 0, error = NI_OK;
+    ni_db * db = NULL;
+
+    if(context == NULL || path == NULL || context->db != NULL)
+	return NI_BAD_ARGUMENT;
+    error = db_open(path, read_only != 0, &db);
+    if(error != NI_OK) return error;
+    char created[context->options.jobs];
+    for(i = 0; i < context->options.jobs; i++){
+	created[i] = (context->memos[i] == NULL);
+	if(created[i]){
+	    context->memos[i] = memo_create(0);
+	    if(context->memos[i] != NULL)
+		context->memos[i]->shared = context->shared;
+	}
+	if(context->memos[i] == NULL || !memo_attach_db(context->memos[i], db))
+	    break;
+    }
+    if(i == context->options.jobs){
+	context->db = db;
+	return NI_OK;
+    }
+    // Takes database back out of the memo tables it was put behind
+    for(; i >= 0; i--){
+	if(created[i]){
+	    memo_free(context->memos[i]);
+	    context->memos[i] = NULL;
+	}
+	else if(context->memos[i]->db == db){
+	    free(context->memos[i]->pending);
+	    context->memos[i]->pending = NULL;
+	    context->memos[i]->db = NULL;
+	}
+    }
+    db_close(db);
+    return NI_NO_MEMORY;
+}
+
+//// ni_compute function
+// Given a context, a word, its size and statistics (may be NULL), returns
+// nesting index of word as compute_NI does with the query and jobs of
+// context, using a memo table of context if one is free.
+int ni_compute(ni_context * context, const unsigned short * word, int size,
+	       ni_stats * stats)
+{
+    int taken = 0, held = 0, NI = 0;
+
+    if(context == NULL || size < 0 || (word == NULL && size > 0))
+	return NI_BAD_ARGUMENT;
+    held = acquire_memos(context, &taken, 1);
+    NI = compute_NI((unsigned short *) word, size,
+		    held? context->memos[taken]: NULL, context->options.jobs,
+		    &context->query, stats);
+    if(held) memo_flush(context->memos[taken]);
+    release_memos(context, &taken, held);
+    return NI;
+}
+
+//// ni_compute_batch function
+// Given a context, count words with their sizes, an array NIs and an array
+// stats (may be NULL), stores the nesting index of each word in NIs and its
+// statistics in stats, as reduce_batch does with the jobs of context and
+// those of its memo tables that are free. Returns NI_OK or NI_BAD_ARGUMENT.
+int ni_compute_batch(ni_context * context,
+		     const unsigned short * const * words, const int * sizes,
+		     int count, int * NIs, ni_stats * stats)
+{
+    int jobs = (context != NULL)? context->options.jobs: 1;
+    memo_table * memos[jobs];
+    int taken[jobs];
+    int held = 0, i = 0;
+
+    if(context == NULL || count < 0 ||
+       (count > 0 && (words == NULL || sizes == NULL || NIs == NULL)))
+	return NI_BAD_ARGUMENT;
+    for(i = 0; i < count; i++)
+	if(sizes[i] < 0 || (words[i] == NULL && sizes[i] > 0))
+	    return NI_BAD_ARGUMENT;
+    if(count == 0) return NI_OK;
+    held = acquire_memos(context, taken, jobs);
+    for(i = 0; i < jobs; i++)
+	memos[i] = (i < held)? context->memos[taken[i]]: NULL;
+    reduce_batch((unsigned short **) words, (int *) sizes, NIs, count, memos,
+		 jobs, &context->query, stats);
+    for(i = 0; i < held; i++) memo_flush(memos[i]);
+    release_memos(context, taken, held);
+    return NI_OK;
+}
+
+//// ni_compute_classes function
+// Given a context, count words with their sizes, arrays NIs and class_sizes
+// and an array stats (may be NULL), stores the nesting indices of the class
+// of each word in NIs, their number in class_sizes and the statistics of
+// each class in stats, as reduce_classes does with the jobs of context and
+// those of its memo tables that are free. Returns NI_OK or NI_BAD_ARGUMENT.
+int ni_compute_classes(ni_context * context,
+		       const unsigned short * const * words, const int * sizes,
+		       int count, int ** NIs, int * class_sizes,
+		       ni_stats * stats)
+{
+    int jobs = (context != NULL)? context->options.jobs: 1;
+    memo_table * memos[jobs];
+    int taken[jobs];
+    int held = 0, i = 0;
+
+    if(context == NULL || count < 0 ||
+       (count > 0 && (words == NULL || sizes == NULL || NIs == NULL ||
+		      class_sizes == NULL)))
+	return NI_BAD_ARGUMENT;
+    for(i = 0; i < count; i++)
+	if(sizes[i] < 0 || (words[i] == NULL && sizes[i] > 0) || NIs[i] == NULL)
+	    return NI_BAD_ARGUMENT;
+    if(count == 0) return NI_OK;
+    held = acquire_memos(context, taken, jobs);
+    for(i = 0; i < jobs; i++)
+	memos[i] = (i < held)? context->memos[taken[i]]: NULL;
+    reduce_classes((unsigned short **) words, (int *) sizes, NIs, class_sizes,
+		   count, memos, jobs, &context->query, stats);
+    for(i = 0; i < held; i++) memo_flush(memos[i]);
+    release_memos(context, taken, held);
+    return NI_OK;
+}
+
+//// ni_reduction function
+// Given a context, a word, its size and arrays path, sizes and steps (see
+// nestindex.h), writes a shortest reduction of word as get_reduction does,
+// using a memo table of context if one is free. Returns nesting index of
+// word or an error code. Words of odd size, which ni_compute reduces as if
+// their single letter were not there, are not DOWs here: their reductions
+// would not fit in path.
+int ni_reduction(ni_context * context, const unsigned short * word, int size,
+		 unsigned short * path, int * sizes, int * steps)
+{
+    int taken = 0, held = 0, NI = 0;
+
+    if(context == NULL || size < 0 ||
+       (size > 0 && (word == NULL || path == NULL || sizes == NULL ||
+		     steps == NULL)))
+	return NI_BAD_ARGUMENT;
+    if(size % 2 != 0 || size > MAX_DOW_SIZE) return NI_NOT_DOW;
+    held = acquire_memos(context, &taken, 1);
+    NI = get_reduction((unsigned short *) word, size,
+		       held? context->memos[taken]: NULL, &context->query,
+		       path, sizes, steps);
+    if(held) memo_flush(context->memos[taken]);
+    release_memos(context, &taken, held);
+    return NI;
+}
+
+//// ni_canonical function
+// Given a word, its size and room for size letters (may be word), writes the
+// canonical word of the class of word to canonical (see get_canonical).
+// Returns the number of words in class, or NI_NOT_DOW.
+int ni_canonical(const unsigned short * word, int size,
+		 unsigned short * canonical)
+{
+    int class_size = 0;
+
+    if(size < 0 || (size > 0 && (word == NULL || canonical == NULL)))
+	return NI_BAD_ARGUMENT;
+    if(size > MAX_DOW_SIZE) return NI_NOT_DOW;
+    class_size = get_canonical((unsigned short *) word, size, canonical);
+    return (class_size == 0)? NI_NOT_DOW: class_size;
+}
+
+//// ni_isomorphisms function
+// Given a word, its size and room for NI_ISOMORPHISMS_ROOM(size) letters,
+// writes the words cyclically equivalent to word to isomorphisms (see
+// get_isomorphisms) and returns their number, or NI_NOT_DOW if word is
+// longer than MAX_DOW_SIZE.
+int ni_isomorphisms(const unsigned short * word, int size,
+		    unsigned short * isomorphisms)
+{
+    if(size < 0 || (size > 0 && (word == NULL || isomorphisms == NULL)))
+	return NI_BAD_ARGUMENT;
+    if(size > MAX_DOW_SIZE) return NI_NOT_DOW;
+    return get_isomorphisms((unsigned short *) word, size, isomorphisms);
+}
+
+//// ni_parse_word function
+// Given a string of length chars (not necessarily null terminated) and an
+// array word with room for length letters, stores in word the letters of
+// the word in string and returns the number of letters. If string has no
+// punctuation, each char is a letter; otherwise letters are the decimal
+// numbers between the chars of LETTER_DELIMITERS. Returns NI_BAD_ARGUMENT,
+// with word undefined, if string has any other char than digits (and the
+// delimiters).
+int ni_parse_word(const char * str, int length, unsigned short * word)
+{
+    int i = 0, size = 0;
+    unsigned int value = 0;
+    short isdelimited = 0, inLetter = 0;
+
+    for(i = 0; i < length && !isdelimited; i++)
+	isdelimited = ispunct((unsigned char) str[i]);
+
+    if(!isdelimited){
+	// Converts chars to ints
+	for(i = 0; i < length; i++){
+	    if(!isdigit((unsigned char) str[i])) return NI_BAD_ARGUMENT;
+	    word[i] = (unsigned short) (str[i] - '0');
+	}
+	return length;
+    }
+    for(i = 0; i < length; i++){
+	if(str[i] != '\0' && strchr(LETTER_DELIMITERS, str[i]) != NULL){
+	    if(inLetter) word[size++] = (unsigned short) value;
+	    inLetter = 0;
+	}
+	else if(!isdigit((unsigned char) str[i]))
+	    return NI_BAD_ARGUMENT;
+	else{
+	    // Parses letter digit by digit
+	    value = (inLetter? 10*value: 0) + (str[i] - '0');
+	    inLetter = 1;
+	}
+    }
+    if(inLetter) word[size++] = (unsigned short) value;
+    return size;
+}
+
+//// ni_memo_stats function
+// Given a context, stores the combined hit, miss and eviction counts,
+// entries and bytes of its memo tables, and those of its shared memo, in
+// counts. Waits for calls holding the tables.
+void ni_memo_stats(ni_context * context, ni_memo_counts * counts)
+{
+    int i = 0;
+
+    memset(counts, 0, sizeof(ni_memo_counts));
+    for(i = 0; context != NULL && i < context->options.jobs; i++){
+	if(context->memos[i] == NULL) continue;
+	pthread_mutex_lock(&context->locks[i]);
+	counts->hits += context->memos[i]->hits;
+	counts->misses += context->memos[i]->misses;
+	counts->evictions += context->memos[i]->evictions;
+	counts->entries += context->memos[i]->count;
+	counts->bytes += context->memos[i]->bytes;
+	counts->db_hits += context->memos[i]->db_hits;
+	counts->db_misses += context->memos[i]->db_misses;
+	counts->tables++;
+	pthread_mutex_unlock(&context->locks[i]);
+    }
+    if(context != NULL && context->shared != NULL)
+	shared_memo_counts(context->shared, counts);
+    if(context != NULL && context->db != NULL)
+	counts->db_entries = atomic_load(&atomic_load(&context->db->map)->
+					 header->count);
+}
+
+//// ni_error_string function
+// Given an error code, returns a description of it.
+const char * ni_error_string(int code)
+{
+    switch(code){
+    case NI_OK: return "success";
+    case NI_NOT_DOW: return "not DOW";
+    case NI_NO_MEMORY: return "out of memory";
+    case NI_ABOVE_BOUND: return "above bound";
+    case NI_BAD_ARGUMENT: return "bad argument";
+    case NI_BAD_DATABASE: return "bad database";
+    case NI_CANCELLED: return "cancelled";
+    case NI_OVER_BUDGET: return "over budget";
+    default: return "unknown error";
+    }
+}
+
+
+//// acquire_memos function
+// Given a context, an array taken and a number wanted, takes up to wanted
+// memo tables of context that no other call holds, storing their indices in
+// taken. Returns the number of tables taken.
+int acquire_memos(ni_context * context, int * taken, int wanted)
+{
+    int i = 0, count = 0;
+
+    for(i = 0; i < context->options.jobs && count < wanted; i++){
+	if(context->memos[i] == NULL) continue;
+	if(pthread_mutex_trylock(&context->locks[i]) == 0) taken[count++] = i;
+    }
+    return count;
+}
+
+//// release_memos function
+// Given a context and the indices of count memo tables taken by
+// acquire_memos, gives the tables back.
+void release_memos(ni_context * context, int * taken, int count)
+{
+    int i = 0;
+
+    for(i = 0; i < count; i++)
+	pthread_mutex_unlock(&context->locks[taken[i]]);
+}
+
+
+//// reduce_batch function
+// Given an array of words with their sizes and count, an array NIs, memo
+// tables, a number of threads (jobs), a query and an array stats (NULL if
+// statistics are off), stores the nesting index of each word in NIs and its
+// statistics in stats.
+void reduce_batch(unsigned short ** words, int * sizes, int * NIs, int count,
+		  memo_table ** memos, int jobs, const ni_query * query,
+		  ni_stats * stats)
+{
+    batch_job job;
+
+    job.words = words;
+    job.sizes = sizes;
+    job.NIs = NIs;
+    job.class_NIs = NULL;
+    job.class_sizes = NULL;
+    job.count = count;
+    job.query = query;
+    job.stats = stats;
+    run_batch(&job, memos, jobs);
+}
+
+//// reduce_classes function
+// Same as reduce_batch, but stores in NIs[i] (room for 2*sizes[i] + 1 ints)
+// the nesting indices of the class of words[i] and in class_sizes[i] their
+// number, as compute_class does.
+void reduce_classes(unsigned short ** words, int * sizes, int ** NIs,
+		    int * class_sizes, int count, memo_table ** memos,
+		    int jobs, const ni_query * query, ni_stats * stats)
+{
+    batch_job job;
+
+    job.words = words;
+    job.sizes = sizes;
+    job.NIs = NULL;
+    job.class_NIs = NIs;
+    job.class_sizes = class_sizes;
+    job.count = count;
+    job.query = query;
+    job.stats = stats;
+    run_batch(&job, memos, jobs);
+}
+
+//// run_batch function
+// Given a batch job, memo tables and a number of threads (jobs), runs
+// batch_worker on jobs threads, or fewer if job has fewer words, each with
+// a memo table of its own. Does nothing if job has no words.
+void run_batch(batch_job * job, memo_table ** memos, int jobs)
+{
+    batch_worker_arg args[jobs];
+    int i = 0;
+
+    if(job->count == 0) return;
+    atomic_init(&job->next, 0);
+    for(i = 0; i < jobs; i++){
+	args[i].job = job;
+	args[i].memo = memos[i];
+    }
+    run_threads(batch_worker, args, sizeof(batch_worker_arg),
+		(job->count < jobs)? job->count: jobs);
+}
+
+//// batch_worker function
+// Thread routine for reduce_batch and reduce_classes. Given a
+// batch_worker_arg, reduces words (or classes) of its job not yet taken
+// until none are left.
+void * batch_worker(void * arg)
+{
+    batch_worker_arg * worker = (batch_worker_arg *) arg;
+    batch_job * job = worker->job;
+    ni_stats * stats = NULL;
+    int i = 0;
+
+    while((i = atomic_fetch_add(&job->next, 1)) < job->count){
+	stats = (job->stats != NULL)? &job->stats[i]: NULL;
+	if(job->class_NIs != NULL)
+	    job->class_sizes[i] = compute_class(job->words[i], job->sizes[i],
+						worker->memo, job->query,
+						job->class_NIs[i], stats);
+	else
+	    job->NIs[i] = compute_NI(job->words[i], job->sizes[i],
+				     worker->memo, 1, job->query, stats);
+    }
+    return NULL;
+}
+
+
+//// get_canonical function
+// Given a word, its size and room for size letters, writes to canonical the
+// canonical word of the class of words cyclically equivalent to word (as in
+// get_isomorphisms). Returns the number of words in class, or 0 if word is
+// not a DOW. canonical may be word itself.
+// A DOW is encoded by the distance from each letter forward (cyclically) to
+// the other occurrence of that letter. The encoding does not change with
+// relabeling, rotates with the word and, for the reverse of the word, is
+// reversed and taken from size. Canonical word is the relabeled rotation of
+// word or of its reverse whose encoding is the least rotation of the two
+// encodings, found in linear time with Booth's algorithm.
+int get_canonical(unsigned short * word, int size, unsigned short * canonical)
+{
+    int partners[size + 1], forward[size + 1], backward[size + 1];
+    unsigned short temp_word[size + 1];
+    int i = 0, j = 0, order = 0, forward_start = 0, backward_start = 0;
+    int period = 0, symmetric = 0;
+
+    if(!get_partners(word, size, partners)) return 0;
+    if(size == 0) return 1;
+    for(i = 0; i < size; i++){
+	forward[i] = (partners[i] - i + size) % size;
+	backward[size - 1 - i] = size - forward[i];
+    }
+    forward_start = least_rotation(forward, size);
+    backward_start = least_rotation(backward, size);
+    for(i = 0; i < size && order == 0; i++)
+	order = backward[(backward_start + i) % size] -
+	    forward[(forward_start + i) % size];
+    symmetric = (order == 0);
+
+    // Smallest rotation of encoding giving it back, with partners as room
+    partners[0] = 0;
+    for(i = 1, j = 0; i < size; i++){
+	while(j > 0 && forward[i] != forward[j]) j = partners[j - 1];
+	if(forward[i] == forward[j]) j++;
+	partners[i] = j;
+    }
+    period = size - partners[size - 1];
+    if(size % period != 0) period = size;
+
+    for(i = 0; i < size; i++){
+	if(order < 0)	// Rotation of reverse
+	    temp_word[i] = word[(2*size - 1 - backward_start - i) % size];
+	else temp_word[i] = word[(forward_start + i) % size];
+    }
+    memcpy(canonical, temp_word, sizeof(short)*size);
+    relabel(canonical, size);
+    return symmetric? period: 2*period;
+}
+
+
+//// get_partners function
+// Given a word, its size and room for size ints, sets partners[i] to the
+// position of the other occurrence of the letter at i. Returns 0 if word is
+// not a DOW, else 1. See index_word.
+int get_partners(unsigned short * word, int size, int * partners)
+{
+    letter_index index = {partners, NULL};
+    int i = 0;
+
+    if(!index_word(word, size, &index)) return 0;
+    for(i = 0; i < size; i++)
+	if(partners[i] == -1) return 0;
+    return 1;
+}
+
+
+//// least_rotation function
+// Given a sequence of ints and its size, returns the start of its
+// lexicographically least rotation (Booth's algorithm).
+int least_rotation(int * seq, int size)
+{
+    int failure[2*size + 1];
+    int start = 0, i = 0, j = 0, next = 0;
+
+    for(j = 0; j < 2*size; j++) failure[j] = -1;
+    for(j = 1; j < 2*size; j++){
+	next = seq[j % size];
+	i = failure[j - start - 1];
+	while(i != -1 && next != seq[(start + i + 1) % size]){
+	    if(next < seq[(start + i + 1) % size]) start = j - i - 1;
+	    i = failure[i];
+	}
+	if(next != seq[(start + i + 1) % size]){	// i is -1
+	    if(next < seq[start % size]) start = j;
+	    failure[j - start] = -1;
+	}
+	else failure[j - start] = i + 1;
+    }
+    return start % size;
+}
+
+
+//// run_threads function
+// Given a thread routine, an array of jobs arguments for it, the size of each
+// argument and jobs, runs routine on jobs threads, one per argument, and
+// waits for them, jobs being at least 1. The calling thread runs routine on
+// the first argument. Routines must finish the work of threads that cannot
+// be started, which holds when all threads take work from a shared pool.
+void run_threads(void * (* routine)(void *), void * args, size_t arg_size,
+		 int jobs)
+{
+    pthread_t threads[jobs];
+    int i = 0, started = 0;
+
+    assert(jobs >= 1);
+    for(started = 1; started < jobs; started++){
+	if(pthread_create(&threads[started], NULL, routine,
+			  (char *) args + started*arg_size) != 0)
+	    break;
+    }
+    routine(args);
+    for(i = 1; i < started; i++) pthread_join(threads[i], NULL);
+}
+
+
+//// step function - performs one reduction step
+// Given a DOW word, its size, arrays children and sizes with room for size/2
+// words and an arena, stores in children the words obtained from either
+// operation 1: removing maximal subwords from word and or from operation 2:
+// removing a of letter of word not contained in a maximal subword. Recall
+// from http://arxiv.org/abs/1311.3543 that a maximal subword is repeat word or
+// return word that contains no other repeat word or return word as a subword.
+// Words are allocated from arena and their sizes are stored in sizes. Returns
+// number of words stored, 0 if a step results in the empty word or -1 if
+// memory could not be alloc'd. Counts go to stats, which may be NULL.
+int step(unsigned short * word, int size, unsigned short ** children,
+	 int * sizes, word_arena * arena, ni_stats * stats)
+{
+    unsigned short * reduction_list[size/2 + 1];
+    unsigned short drop_list[size/2 + 1], reduced[size + 1];
+    int partners[size + 1];
+    unsigned int in_seqs[INDEX_MASKS(size + 1)];
+    letter_index index = {partners, in_seqs};
+    int seq_count = 0, drop_ctr = 0, count = 0, i = 0;
+    int new_size = 0;	// Size of word with seqs removed
+    // Only important size since rest will be size - 2
+	
+    STATS_ADD(stats, steps, 1);
+    // If size <= 4, step results in empty word, regardless of DOW given
+    if(size <= 4) return 0;
+#if PACKED_LETTERS >= 16
+    if(size <= 16 &&
+       (count = step_packed16(word, size, children, sizes, arena,
+			      stats)) != PACKED_UNFIT)
+	return count;
+#endif
+#if PACKED_LETTERS == 32
+    if(size > 16 && size <= 32 &&
+       (count = step_packed32(word, size, children, sizes, arena,
+			      stats)) != PACKED_UNFIT)
+	return count;
+#endif
+    count = 0;
+    index_word(word, size, &index);
+    seq_count = get_repeat_return_words(word, size, reduction_list);
+    STATS_ADD(stats, subwords, seq_count);
+    index_seqs(&index, word, size, reduction_list, seq_count);
+
+    // Creates list of letters, not in repeat/return word, to be dropped,
+    // in order of first occurrence
+    if(seq_count > 0){	
+	// Checks if letters are in repeat/return word
+	for(i = 0; i < size; i++){		
+	    if(partners[i] > i && !IN_SEQ(&index, i))
+		drop_list[drop_ctr++] = word[i];
+	}
+	// Word with seqs removed goes in first position
+	remove_seqs(word, size, &index, reduced, &new_size);
+	if(new_size == 0) return 0;
+	children[0] = arena_alloc(arena, new_size);
+	if(children[0] == NULL) return -1;
+	memcpy(children[0], reduced, sizeof(unsigned short)*new_size);
+	relabel(children[0], new_size);
+	sizes[0] = new_size;
+	count = 1;
+    }
+    else{ // Every letter in word goes to drop list
+	for(i = 0; i < size; i++)
+	    if(partners[i] > i) drop_list[drop_ctr++] = word[i];
+    }
+    // This gets words with letter from drop_list removed
+    for(i = 0; i < drop_ctr; i++){
+	children[count] = arena_alloc(arena, size - 2);
+	if(children[count] == NULL) return -1;
+	remove_ltr(word, size, drop_list[i], children[count]);
+	relabel(children[count], size - 2);
+	sizes[count++] = size - 2;
+    }
+    STATS_ADD(stats, children, count);
+    return count;
+}
+
+//// step_packed functions
+// PACKED_STEP(name, type, letters, ctz, reverse) defines a step for words of
+// up to letters letters packed in type; ctz counts trailing zero bits of a
+// nonzero type and reverse reverses the order of nibbles of a type. Gives
+// the same children as step, in the same order, or PACKED_UNFIT if a letter
+// of word is not in 1..16. Letters are found with bit tricks on the packed
+// word: nibbles equal to a letter are the zero nibbles of word ^ letter
+// spread over all nibbles. Letters in maximal subwords are kept as a bitset.
+// Children are relabeled with a lookup table as they are unpacked.
+#define PACKED_STEP(name, type, letters, ctz, reverse)			\
+int name(unsigned short * word, int size, unsigned short ** children,	\
+	 int * sizes, word_arena * arena, ni_stats * stats)		\
+{									\
+    const type ones = ((type) -1)/15;	/* Lowest bit of each nibble */	\
+    unsigned short * reduction_list[size/2 + 1];			\
+    unsigned short order[size/2];					\
+    unsigned char labels[16];						\
+    type packed = 0, reduced = 0, child = 0, zeros = 0, low = 0;	\
+    type valid = (size == letters)? ~(type) 0:				\
+	(((type) 1 << 4*size) - 1);					\
+    unsigned int in_seqs = 0, seen = 0, nibble = 0;			\
+    int seq_count = 0, count = 0, i = 0, j = 0, new_size = 0;		\
+    int first = 0, second = 0, mid = 0;					\
+    unsigned short next_label = 0;					\
+									\
+    /* Odd words passed by is_double_occurrence have an extra letter */	\
+    if(size % 2 != 0) return PACKED_UNFIT;				\
+    for(i = 0; i < size; i++){						\
+	if(word[i] < 1 || word[i] > 16) return PACKED_UNFIT;		\
+	packed |= (type) (word[i] - 1) << 4*i;				\
+	if(!(seen & 1u << (word[i] - 1))){				\
+	    seen |= 1u << (word[i] - 1);				\
+	    order[j++] = word[i];					\
+	}								\
+    }									\
+    seq_count = get_repeat_return_words(word, size, reduction_list);	\
+    STATS_ADD(stats, subwords, seq_count);				\
+    /* A maximal subword runs from its start while letters increase */	\
+    for(i = 0; i < seq_count; i++){					\
+	j = reduction_list[i] - word;					\
+	do{								\
+	    in_seqs |= 1u << (word[j] - 1);				\
+	    j++;							\
+	} while(j < size && word[j] > word[j - 1]);			\
+    }									\
+    if(seq_count > 0){							\
+	for(i = 0; i < size; i++){					\
+	    nibble = (unsigned int) (packed >> 4*i) & 15;		\
+	    if(!(in_seqs & 1u << nibble))				\
+		reduced |= (type) nibble << 4*new_size++;		\
+	}								\
+	if(new_size == 0) return 0;					\
+	children[0] = arena_alloc(arena, new_size);			\
+	if(children[0] == NULL) return -1;				\
+	memset(labels, 0, sizeof(labels));				\
+	next_label = 0;							\
+	for(i = 0; i < new_size; i++){					\
+	    nibble = (unsigned int) (reduced >> 4*i) & 15;		\
+	    if(!labels[nibble]) labels[nibble] = ++next_label;		\
+	    children[0][i] = labels[nibble];				\
+	}								\
+	sizes[0] = new_size;						\
+	count = 1;							\
+    }									\
+    for(i = 0; i < size/2; i++){					\
+	if(in_seqs & 1u << (order[i] - 1)) continue;			\
+	/* Zero nibbles of packed ^ letter are its two occurrences */	\
+	zeros = packed ^ (ones*(order[i] - 1));				\
+	zeros = ~(zeros | zeros >> 1 | zeros >> 2 | zeros >> 3) & ones & valid; \
+	first = ctz(zeros)/4;						\
+	zeros &= zeros - 1;						\
+	second = ctz(zeros)/4;						\
+	/* As remove_ltr: letters between occurrences are reversed */	\
+	mid = second - first - 1;					\
+	low = (first == 0)? 0: packed & (((type) 1 << 4*first) - 1);	\
+	child = low;							\
+	if(mid > 0)							\
+	    child |= (reverse(packed >> 4*(first + 1)) >>		\
+		      4*(letters - mid)) << 4*first;			\
+	if(second + 1 < letters)					\
+	    child |= (packed >> 4*(second + 1)) << 4*(second - 1);	\
+	children[count] = arena_alloc(arena, size - 2);			\
+	if(children[count] == NULL) return -1;				\
+	memset(labels, 0, sizeof(labels));				\
+	next_label = 0;							\
+	for(j = 0; j < size - 2; j++){					\
+	    nibble = (unsigned int) (child >> 4*j) & 15;		\
+	    if(!labels[nibble]) labels[nibble] = ++next_label;		\
+	    children[count][j] = labels[nibble];			\
+	}								\
+	sizes[count++] = size - 2;					\
+    }									\
+    STATS_ADD(stats, children, count);					\
+    return count;							\
+}
+
+#if PACKED_LETTERS >= 16
+PACKED_STEP(step_packed16, unsigned long long, 16, __builtin_ctzll,
+	    reverse_nibbles64)
+#endif
+#if PACKED_LETTERS == 32
+PACKED_STEP(step_packed32, unsigned __int128, 32, ctz128, reverse_nibbles128)
+#endif
+
+//// reverse_nibbles64 function
+// Given a packed word, returns it with the order of its 16 nibbles reversed
+unsigned long long reverse_nibbles64(unsigned long long packed)
+{
+    packed = __builtin_bswap64(packed);
+    return (packed >> 4 & 0x0F0F0F0F0F0F0F0FULL) |
+	(packed & 0x0F0F0F0F0F0F0F0FULL) << 4;
+}
+
+#if PACKED_LETTERS == 32
+//// reverse_nibbles128 function
+// Given a packed word, returns it with the order of its 32 nibbles reversed
+unsigned __int128 reverse_nibbles128(unsigned __int128 packed)
+{
+    return (unsigned __int128) reverse_nibbles64((unsigned long long) packed)
+	<< 64 | reverse_nibbles64((unsigned long long) (packed >> 64));
+}
+
+//// ctz128 function
+// Given a nonzero packed word, returns the number of its trailing zero bits
+int ctz128(unsigned __int128 packed)
+{
+    if((unsigned long long) packed != 0)
+	return __builtin_ctzll((unsigned long long) packed);
+    return 64 + __builtin_ctzll((unsigned long long) (packed >> 64));
+}
+#endif
+
+//// get_NI function
+// Given a word, its size and a memo table (may be NULL), returns nesting index
+// of word, NI_NOT_DOW if word is not double occurrence or NI_NO_MEMORY if
+// memory could not be alloc'd. Function does not modify word and is safe to
+// call from several threads with distinct memos.
+int get_NI(unsigned short * word, int size, memo_table * memo)
+{
+    return get_NI_parallel(word, size, memo, 1);
+}
+
+//// get_NI_parallel function
+// Same as get_NI, but levels of at least PARALLEL_MIN_WORDS words are
+// expanded by jobs threads.
+int get_NI_parallel(unsigned short * word, int size, memo_table * memo,
+		    int jobs)
+{
+    return get_NI_bounded(word, size, memo, jobs, &full_query, NULL);
+}
+
+//// get_NI_bounded function
+// Same as get_NI_parallel, but returns NI_ABOVE_BOUND as soon as nesting
+// index is known to be above the bound of query, which is when no word of
+// level bound - 1 steps to the empty word, NI_CANCELLED once the cancel
+// function of query asks to stop and NI_OVER_BUDGET once a level hits a
+// limit of query (see level_limit). Words of that level are only checked with
+// steps_to_empty, so level bound is never built. Words of each level whose
+// nesting index is already in memo are not expanded; they only bound the
+// result. The result for word is added to memo. The words of a level live in
+// arenas, which are reset once the next level has been built from them. The
+// arenas are taken from memo and given back to it, so later calls reuse
+// their blocks.
+// Counts of the reduction go to stats, which may be NULL; words reduced for
+// memo are not counted.
+int get_NI_bounded(unsigned short * word, int size, memo_table * memo,
+		   int jobs, const ni_query * query, ni_stats * stats)
+{
+    unsigned short ** current_words = NULL, ** next_words = NULL;
+    int * next_sizes = NULL, * current_sizes = NULL;
+    int sizes_sum = 0, empty_index = 0;
+    int current_count = 0, next_count = 0, step_count = 0;
+    int i = 0, NI = 0, best = INT_MAX, bound = query->bound, limit = 0;
+    short found_empty = 0;
+    word_arena arenas[2*jobs], * current_arenas = arenas,
+	* next_arenas = arenas + jobs, * swap_arenas = NULL;
+		
+    // Checks if word is double occurrence
+    if(!is_double_occurrence(word, size)) return NI_NOT_DOW;
+
+    // Handles case if word is empty word
+    NI = 0;
+    if(size == 0) return NI;
+    if(bound < 1) return NI_ABOVE_BOUND;
+
+    // Memo is keyed on words by their letters as given. Maximal subwords are
+    // found from the differences of consecutive letters, so the result for a
+    // word that is not relabeled may differ from that of its relabeled copy;
+    // such a word is kept as it is, and no relabeled child can match it.
+    if(memo != NULL && (NI = memo_lookup(memo, word, size)) != -1)
+	return (NI > bound)? NI_ABOVE_BOUND: NI;
+    NI = 0;
+
+    current_words = (unsigned short **) malloc(sizeof(unsigned short *)*(size/2));
+    current_sizes = (int *) malloc(sizeof(int)*(size/2));
+    if(current_sizes == NULL || current_words == NULL){
+	if(current_sizes != NULL) free(current_sizes);
+	if(current_words != NULL) free(current_words);
+	return NI_NO_MEMORY;
+    }
+    memo_take_arenas(memo, arenas, 2*jobs);
+    current_count = step(word, size, current_words, current_sizes,
+			 current_arenas, stats);
+    step_count = current_count;
+    NI++;
+    found_empty = (current_count == 0);	// First step gives empty word
+    if(current_count < 0 ||
+       (!found_empty && !copy_words(current_words, current_sizes, current_words,
+				    current_sizes, &current_count))){
+	found_empty = 1;	// Stops reduction
+	NI = NI_NO_MEMORY;
+    }
+    // Best upper bound on NI from words found in memo
+    else if(!found_empty){
+	STATS_ADD(stats, duplicates, step_count - current_count);
+	count_level(stats, current_words, current_sizes, current_count);
+	best = filter_known_words(memo, current_words, current_sizes,
+				  &current_count, NI, best);
+    }
+
+    // Runs while there is no empty empty word
+    while(!found_empty){
+	NI++;
+	// Every remaining word needs at least one more step, so a bound from
+	// memo that is no more than NI is the nesting index
+	if(best <= NI || current_count == 0){
+	    NI = (best > bound)? NI_ABOVE_BOUND: best;
+	    break;
+	}
+	if(NI > bound){
+	    NI = NI_ABOVE_BOUND;
+	    break;
+	}
+	if(QUERY_CANCELLED(query)){
+	    NI = NI_CANCELLED;
+	    break;
+	}
+	// Every remaining word needs at least one more step, and each one
+	// gives a reduction
+	if((limit = level_limit(query, current_words, current_sizes,
+				current_count, NI == bound)) != NI_LIMIT_NONE){
+	    record_cut_off(stats, limit, NI, NI - 1, current_words,
+			   current_sizes, current_count, best);
+	    NI = NI_OVER_BUDGET;
+	    break;
+	}
+	// Last level within bound only has to hold a word stepping to the
+	// empty word
+	if(NI == bound){
+	    for(i = 0; i < current_count; i++)
+		if(steps_to_empty(current_words[i], current_sizes[i])) break;
+	    if(i == current_count) NI = NI_ABOVE_BOUND;
+	    else if(memo != NULL && current_sizes[i] > 4)
+		memo_insert(memo, current_words[i], current_sizes[i], 1);
+	    break;
+	}
+	// Gets upper bound on # of branch points from current words for memory
+	// allocation
+	sizes_sum = 0;
+	for(i = 0; i < current_count; i++)
+	    sizes_sum += current_sizes[i];
+	sizes_sum /= 2;
+	next_words = malloc(sizeof(unsigned short *)*sizes_sum);
+	next_sizes = malloc(sizeof(int)*sizes_sum);
+	if(next_sizes == NULL || next_words == NULL){
+	    if(next_sizes != NULL) free(next_sizes);
+	    if(next_words != NULL) free(next_words);
+	    NI = NI_NO_MEMORY;
+	    break;
+	}
+	next_count = expand_level(current_words, current_sizes, current_count,
+				  next_words, next_sizes, next_arenas,
+				  (current_count < PARALLEL_MIN_WORDS)? 1: jobs,
+				  &empty_index, stats);
+	if(next_count < 0){
+	    found_empty = 1;	// Stops reduction
+	    NI = NI_NO_MEMORY;
+	}
+	else if(empty_index != -1){
+	    // current_words[empty_index] reduces to empty word in one step
+	    found_empty = 1;
+	    if(memo != NULL && current_sizes[empty_index] > 4)
+		memo_insert(memo, current_words[empty_index],
+			    current_sizes[empty_index], 1);
+	}
+
+	// Step complete
+	// Current words become next_words, words of old level are dropped
+	free(current_words);
+	free(current_sizes);
+	current_words = next_words;
+	current_sizes = next_sizes;
+	current_count = next_count;
+	for(i = 0; i < jobs; i++) arena_reset(&current_arenas[i]);
+	swap_arenas = current_arenas;
+	current_arenas = next_arenas;
+	next_arenas = swap_arenas;
+	if(found_empty) break;
+	count_level(stats, current_words, current_sizes, current_count);
+	best = filter_known_words(memo, current_words, current_sizes,
+				  &current_count, NI, best);
+    }
+    free(current_words);
+    free(current_sizes);
+    memo_keep_arenas(memo, arenas, 2*jobs);
+    if(memo != NULL && NI > 0) memo_insert(memo, word, size, NI);
+    return NI;
+}
+
+//// level_limit function
+// Given a query and the words of a level of get_NI_bounded with their sizes
+// and count, and whether level is the last (only checked, not expanded),
+// returns the limit of query (see nestindex.h) that level hits, or
+// NI_LIMIT_NONE.
+int level_limit(const ni_query * query, unsigned short ** words, int * sizes,
+		int count, int last)
+{
+    size_t bytes = 0;
+    int i = 0;
+
+    if(QUERY_OVER_TIME(query)) return NI_LIMIT_TIME;
+    if(last) return NI_LIMIT_NONE;
+    if(query->frontier_limit > 0 && (size_t) count > query->frontier_limit)
+	return NI_LIMIT_FRONTIER;
+    if(query->memory_limit > 0){
+	// Level, then pointers and sizes of as many children as it can have
+	bytes = (sizeof(unsigned short *) + sizeof(int))*count;
+	for(i = 0; i < count; i++)
+	    bytes += sizeof(unsigned short)*sizes[i] +
+		(sizeof(unsigned short *) + sizeof(int))*(sizes[i]/2);
+	if(bytes > query->memory_limit) return NI_LIMIT_MEMORY;
+    }
+    return NI_LIMIT_NONE;
+}
+
+//// record_cut_off function
+// Given stats (may be NULL), the limit a reduction hit, a lower bound on
+// the nesting index of the word reduced, the words of a level level steps
+// from it with their sizes and count, and the best upper bound on its
+// nesting index so far (INT_MAX if none), records the limit and the bounds
+// in stats. The upper bound is improved by greedy reductions (see
+// greedy_steps) of the first GREEDY_WORDS words of level.
+void record_cut_off(ni_stats * stats, int limit, int lower, int level,
+		    unsigned short ** words, int * sizes, int count, int best)
+{
+    int i = 0, steps = 0;
+
+    if(stats == NULL) return;
+    for(i = 0; i < count && i < GREEDY_WORDS; i++)
+	if((steps = greedy_steps(words[i], sizes[i])) >= 0 &&
+	   level + steps < best)
+	    best = level + steps;
+    stats->limit = limit;
+    stats->lower_bound = lower;
+    stats->upper_bound = (best == INT_MAX)? NI_UNBOUNDED: best;
+}
+
+//// greedy_steps function
+// Given a DOW and its size, returns the number of steps to the empty word of
+// the reduction that goes to a shortest child at each step, which bounds
+// the nesting index of word from above, or -1 if memory could not be
+// alloc'd. Only the word reached is kept, so memory is linear in size.
+int greedy_steps(unsigned short * word, int size)
+{
+    unsigned short * children[size/2 + 1];
+    unsigned short current[size + 1];
+    int sizes[size/2 + 1];
+    int count = 0, steps = 0, i = 0, shortest = 0;
+    word_arena arena;
+
+    if(size == 0) return 0;
+    arena_init(&arena);
+    memcpy(current, word, sizeof(unsigned short)*size);
+    do{
+	count = step(current, size, children, sizes, &arena, NULL);
+	steps++;
+	for(i = 1, shortest = 0; i < count; i++)
+	    if(sizes[i] < sizes[shortest]) shortest = i;
+	if(count > 0){
+	    size = sizes[shortest];
+	    memcpy(current, children[shortest], sizeof(unsigned short)*size);
+	    arena_reset(&arena);
+	}
+    } while(count > 0);
+    arena_release(&arena);
+    return (count < 0)? -1: steps;
+}
+
+//// compute_NI function
+// Given a word, its size, a memo table (may be NULL), jobs and a query,
+// returns nesting index of word as get_NI_bounded does, searching with the
+// engine of query. ENGINE_DFS runs on a single thread. Words ENGINE_BFS
+// runs out of memory on are searched again with ENGINE_DFS; words cut off
+// by a limit are not. If stats is not NULL, it is cleared and gets the
+// counts of ENGINE_BFS, the bounds of a word cut off and the wall time.
+int compute_NI(unsigned short * word, int size, memo_table * memo, int jobs,
+	       const ni_query * query, ni_stats * stats)
+{
+    ni_query budgeted = *query;
+    int NI = NI_NO_MEMORY;
+    double start = 0;
+
+    if(stats != NULL){
+	memset(stats, 0, sizeof(ni_stats));
+	start = clock_seconds();
+    }
+    // Words reduced for word share its deadline
+    if(query->time_limit > 0 && query->deadline == 0)
+	budgeted.deadline = clock_seconds() + query->time_limit;
+    if(query->engine == ENGINE_BFS)
+	NI = get_NI_bounded(word, size, memo, jobs, &budgeted, stats);
+    if(NI == NI_NO_MEMORY)
+	NI = get_NI_search(word, size, memo, &budgeted, stats);
+    if(stats != NULL) stats->seconds = clock_seconds() - start;
+    return NI;
+}
+
+//// compute_class function
+// Given a word, its size, a memo table (may be NULL), a query, room for
+// 2*size + 1 nesting indices and stats (may be NULL), stores in NIs the
+// nesting index of each word of the class of word, in the order of
+// get_isomorphisms, and returns their number, or NI_NO_MEMORY. A word that
+// is not a DOW is its own class, with NI_NOT_DOW. With ENGINE_BFS the words
+// of class are reduced together by get_NI_class; words it runs out of
+// memory on, and all words with ENGINE_DFS, are reduced one at a time by
+// compute_NI. If stats is not NULL, it is cleared and gets the counts of
+// get_NI_class and the wall time.
+int compute_class(unsigned short * word, int size, memo_table * memo,
+		  const ni_query * query, int * NIs, ni_stats * stats)
+{
+    unsigned short * isomorphisms = NULL;
+    int count = 0, i = 0;
+    short reduced = 0;
+    double start = 0;
+
+    if(stats != NULL){
+	memset(stats, 0, sizeof(ni_stats));
+	start = clock_seconds();
+    }
+    if(size == 0 || !is_double_occurrence(word, size)){
+	NIs[0] = (size == 0)? 0: NI_NOT_DOW;
+	count = 1;
+    }
+    else{
+	isomorphisms = (unsigned short *) \
+	    malloc(sizeof(unsigned short)*2*(size_t) size*size);
+	if(isomorphisms == NULL) return NI_NO_MEMORY;
+	count = get_isomorphisms(word, size, isomorphisms);
+	if(query->engine == ENGINE_BFS)
+	    reduced = get_NI_class(isomorphisms, count, size, memo, query, NIs,
+				   stats);
+	for(i = 0; i < count && !reduced; i++){
+	    if(query->engine == ENGINE_BFS && NIs[i] != NI_NO_MEMORY) continue;
+	    NIs[i] = compute_NI(isomorphisms + (size_t) i*size, size, memo, 1,
+				query, NULL);
+	}
+	free(isomorphisms);
+    }
+    if(stats != NULL) stats->seconds = clock_seconds() - start;
+    return count;
+}
+
+//// get_NI_class function
+// Given the count words of a class, size letters each one after another (as
+// from get_isomorphisms), a memo table (may be NULL), a query, an array NIs
+// and stats (may be NULL), stores the nesting index of each word in NIs as
+// get_NI_bounded does, reducing the words together. A level holds the words
+// reached from any word of class in as many steps, each once, with the mask
+// of the words of class it was reached from. A word of class gets its
+// nesting index at the first level one of its words steps to the empty
+// word, or from the bounds of memo as in get_NI_bounded; it is then dropped
+// from the masks of later levels, and words left with empty masks are
+// dropped. Words of class must have size > 0. Words whose nesting
+// index could not be found for lack of memory get NI_NO_MEMORY. Returns 0 in
+// that case, else 1.
+short get_NI_class(unsigned short * words, int count, int size,
+		   memo_table * memo, const ni_query * query, int * NIs,
+		   ni_stats * stats)
+{
+    int mask_words = CLASS_MASK_WORDS(count);
+    unsigned long long done[mask_words], present[mask_words];
+    unsigned long long * current_masks = NULL, * next_masks = NULL;
+    unsigned long long * mask = NULL;
+    unsigned short ** current_words = NULL, ** next_words = NULL;
+    int * current_sizes = NULL, * next_sizes = NULL;
+    int best[count];
+    int current_count = 0, next_count = 0, step_count = 0, made = 0;
+    int open = count, level = 0, sizes_sum = 0, NI = 0, bound = query->bound;
+    int i = 0, j = 0, r = 0, ctr = 0;
+    short out_of_memory = 0;
+    word_arena arenas[2];
+
+    memset(done, 0, sizeof(done));
+    for(r = 0; r < count; r++) best[r] = INT_MAX;
+    if(bound < 1){
+	for(r = 0; r < count; r++) NIs[r] = NI_ABOVE_BOUND;
+	return 1;
+    }
+    current_words = (unsigned short **) malloc(sizeof(unsigned short *)*count);
+    current_sizes = (int *) malloc(sizeof(int)*count);
+    current_masks = (unsigned long long *) \
+	calloc((size_t) count*mask_words, sizeof(unsigned long long));
+    if(current_words == NULL || current_sizes == NULL ||
+       current_masks == NULL){
+	free(current_words);
+	free(current_sizes);
+	free(current_masks);
+	for(r = 0; r < count; r++) NIs[r] = NI_NO_MEMORY;
+	return 0;
+    }
+    // Level 0 holds the words of class not found in memo. A word of odd
+    // size may pass as a DOW while some of its rotations do not.
+    for(r = 0; r < count; r++){
+	if(!is_double_occurrence(words + (size_t) r*size, size))
+	    NIs[r] = NI_NOT_DOW;
+	else if(memo != NULL &&
+		(NI = memo_lookup(memo, words + (size_t) r*size, size)) != -1)
+	    NIs[r] = (NI > bound)? NI_ABOVE_BOUND: NI;
+	else{
+	    current_words[current_count] = words + (size_t) r*size;
+	    current_sizes[current_count] = size;
+	    current_masks[(size_t) current_count*mask_words + r/64] = \
+		1ULL << r%64;
+	    current_count++;
+	    continue;
+	}
+	done[r/64] |= 1ULL << r%64;
+	open--;
+    }
+    memo_take_arenas(memo, arenas, 2);
+
+    while(open > 0){
+	level++;	// Level of the words about to be built
+	if(QUERY_CANCELLED(query)){
+	    memset(present, 0xff, sizeof(present));
+	    settle_class(NIs, count, done, present, NI_CANCELLED, NULL, words,
+			 size);
+	    break;
+	}
+	// Last level within bound only has to hold a word stepping to the
+	// empty word, as in get_NI_bounded
+	if(level >= bound){
+	    for(i = 0; i < current_count; i++)
+		if(steps_to_empty(current_words[i], current_sizes[i]))
+		    settle_class(NIs, count, done,
+				 current_masks + (size_t) i*mask_words, level,
+				 memo, words, size);
+	    memset(present, 0xff, sizeof(present));
+	    settle_class(NIs, count, done, present, NI_ABOVE_BOUND, NULL,
+			 words, size);
+	    break;
+	}
+	sizes_sum = 0;
+	for(i = 0; i < current_count; i++)
+	    sizes_sum += current_sizes[i]/2;
+	next_words = (unsigned short **) \
+	    malloc(sizeof(unsigned short *)*(sizes_sum + 1));
+	next_sizes = (int *) malloc(sizeof(int)*(sizes_sum + 1));
+	next_masks = (unsigned long long *) \
+	    malloc(sizeof(unsigned long long)*(sizes_sum + 1)*mask_words);
+	if(next_words == NULL || next_sizes == NULL || next_masks == NULL){
+	    free(next_words);
+	    free(next_sizes);
+	    free(next_masks);
+	    out_of_memory = 1;
+	    break;
+	}
+	next_count = 0;
+	for(i = 0; i < current_count && !out_of_memory; i++){
+	    mask = current_masks + (size_t) i*mask_words;
+	    for(j = 0; j < mask_words && (mask[j] & ~done[j]) == 0; j++);
+	    if(j == mask_words) continue;	// Words of mask settled
+	    step_count = step(current_words[i], current_sizes[i],
+			      next_words + next_count, next_sizes + next_count,
+			      &arenas[level % 2], stats);
+	    if(step_count < 0) out_of_memory = 1;
+	    else if(step_count == 0){
+		open -= settle_class(NIs, count, done, mask, level, memo, words,
+				     size);
+		if(memo != NULL && current_sizes[i] > 4)
+		    memo_insert(memo, current_words[i], current_sizes[i], 1);
+	    }
+	    for(j = 0; j < step_count; j++)
+		memcpy(next_masks + (size_t) (next_count + j)*mask_words, mask,
+		       sizeof(unsigned long long)*mask_words);
+	    if(step_count > 0) next_count += step_count;
+	}
+
+	// Step complete
+	// Current words become next words, words of old level are dropped
+	free(current_words);
+	free(current_sizes);
+	free(current_masks);
+	current_words = next_words;
+	current_sizes = next_sizes;
+	current_masks = next_masks;
+	current_count = next_count;
+	arena_reset(&arenas[(level + 1) % 2]);
+	made = current_count;
+	if(out_of_memory ||
+	   !merge_class_words(current_words, current_sizes, current_masks,
+			      mask_words, done, &current_count)){
+	    out_of_memory = 1;
+	    break;
+	}
+	STATS_ADD(stats, duplicates, made - current_count);
+	if(open == 0) break;
+	count_level(stats, current_words, current_sizes, current_count);
+
+	// Words known to memo bound the words of their masks and are dropped
+	ctr = 0;
+	for(i = 0; i < current_count; i++){
+	    mask = current_masks + (size_t) i*mask_words;
+	    NI = (memo != NULL)? memo_lookup(memo, current_words[i],
+					     current_sizes[i]): -1;
+	    if(NI == -1 && memo != NULL && current_sizes[i] <= MEMO_SMALL_SIZE)
+		NI = get_NI(current_words[i], current_sizes[i], memo);
+	    if(NI >= 0){
+		for(r = 0; r < count; r++)
+		    if(CLASS_BIT(mask, r) && level + NI < best[r])
+			best[r] = level + NI;
+		continue;
+	    }
+	    current_words[ctr] = current_words[i];
+	    current_sizes[ctr] = current_sizes[i];
+	    memmove(current_masks + (size_t) ctr*mask_words, mask,
+		    sizeof(unsigned long long)*mask_words);
+	    ctr++;
+	}
+	current_count = ctr;
+
+	// Every word left needs at least one more step, so a bound that is no
+	// more than the next level is the nesting index; so is the bound of a
+	// word of class with no words left
+	memset(present, 0, sizeof(present));
+	for(i = 0; i < current_count; i++)
+	    for(j = 0; j < mask_words; j++)
+		present[j] |= current_masks[(size_t) i*mask_words + j];
+	for(r = 0; r < count; r++){
+	    if(CLASS_BIT(done, r) ||
+	       (best[r] > level + 1 && CLASS_BIT(present, r)))
+		continue;
+	    NIs[r] = (best[r] > bound)? NI_ABOVE_BOUND: best[r];
+	    done[r/64] |= 1ULL << r%64;
+	    open--;
+	    if(memo != NULL && NIs[r] > 0)
+		memo_insert(memo, words + (size_t) r*size, size, NIs[r]);
+	}
+    }
+    if(out_of_memory){
+	memset(present, 0xff, sizeof(present));
+	settle_class(NIs, count, done, present, NI_NO_MEMORY, NULL, words,
+		     size);
+    }
+    free(current_words);
+    free(current_sizes);
+    free(current_masks);
+    memo_keep_arenas(memo, arenas, 2);
+    return !out_of_memory;
+}
+
+//// settle_class function
+// Given the NIs of get_NI_class, the number of words of class, the mask of
+// words settled, a mask, a nesting index (or error) and a memo table (may be
+// NULL), sets the NI of each word of mask not yet
+// settled, marks it settled and, if NI > 0, adds it to memo; words of class
+// are size letters each, one after another. Returns the number of words
+// settled.
+int settle_class(int * NIs, int count, unsigned long long * done,
+		 unsigned long long * mask, int NI, memo_table * memo,
+		 unsigned short * words, int size)
+{
+    int r = 0, settled = 0;
+
+    for(r = 0; r < count; r++){
+	if(!CLASS_BIT(mask, r) || CLASS_BIT(done, r)) continue;
+	NIs[r] = NI;
+	done[r/64] |= 1ULL << r%64;
+	settled++;
+	if(memo != NULL && NI > 0)
+	    memo_insert(memo, words + (size_t) r*size, size, NI);
+    }
+    return settled;
+}
+
+//// get_reduction function
+// Given a word, its size, a memo table (may be NULL), a query and arrays
+// path, sizes and steps (see ni_reduction), returns nesting index of word
+// as compute_NI does on one thread and, if it is found, writes a reduction
+// of word in that many steps. Each step goes to the first child whose
+// nesting index is one less, children being tried in the order of
+// search_reduction; with memo, their nesting indices are mostly known from
+// reducing word.
+int get_reduction(unsigned short * word, int size, memo_table * memo,
+		  const ni_query * query, unsigned short * path, int * sizes,
+		  int * steps)
+{
+    unsigned short * reduction_list[size/2 + 1];
+    unsigned short child[size + 1];
+    int partners[size + 1];
+    unsigned int in_seqs[INDEX_MASKS(size) + 1];
+    letter_index index = {partners, in_seqs};
+    ni_query child_query = *query;
+    unsigned short * current = path;
+    int NI = 0, level = 0, seq_count = 0, child_size = 0, child_NI = 0;
+    int current_size = size, i = 0;
+
+    NI = compute_NI(word, size, memo, 1, query, NULL);
+    if(NI <= 0) return NI;
+    memcpy(path, word, sizeof(unsigned short)*size);
+    for(level = 0; level < NI; level++){
+	sizes[level] = current_size;
+	index_word(current, current_size, &index);
+	seq_count = get_repeat_return_words(current, current_size,
+					    reduction_list);
+	index_seqs(&index, current, current_size, reduction_list, seq_count);
+	// A child reduces in NI - level - 1 steps if it is within that bound
+	child_query.bound = NI - level - 1;
+	child_NI = NI_ABOVE_BOUND;
+	if(seq_count > 0){
+	    remove_seqs(current, current_size, &index, child, &child_size);
+	    relabel(child, child_size);
+	    child_NI = compute_NI(child, child_size, memo, 1, &child_query,
+				  NULL);
+	    steps[level] = 0;
+	}
+	for(i = 0; i < current_size && child_NI == NI_ABOVE_BOUND; i++){
+	    if(partners[i] < i || IN_SEQ(&index, i)) continue;
+	    child_size = current_size - 2;
+	    remove_ltr(current, current_size, current[i], child);
+	    relabel(child, child_size);
+	    child_NI = compute_NI(child, child_size, memo, 1, &child_query,
+				  NULL);
+	    steps[level] = current[i];
+	}
+	if(child_NI < 0) return child_NI;
+	memcpy(current + current_size, child,
+	       sizeof(unsigned short)*child_size);
+	current += current_size;
+	current_size = child_size;
+    }
+    return NI;
+}
+
+//// get_NI_search function
+// Same as get_NI_bounded, but searches depth first with iterative
+// deepening: nesting index is the least depth d such that a sequence of d
+// steps reduces word to the empty word (see search_reduction). Only the
+// word being tried at each depth is kept, so besides the table below memory
+// is linear in size times nesting index. Depths refuted for words met in
+// search are kept in a memo table of table_budget bytes (the value stored
+// for a word is a depth it does not reduce in), so later iterations and
+// repeated children skip them. Only the time limit of query applies; the
+// bounds of a word cut off go to stats, which may be NULL.
+int get_NI_search(unsigned short * word, int size, memo_table * memo,
+		  const ni_query * query, ni_stats * stats)
+{
+    memo_table * refuted = NULL;
+    int NI = 0, depth = 0, bound = query->bound;
+    short found = 0;
+
+    if(!is_double_occurrence(word, size)) return NI_NOT_DOW;
+    if(size == 0) return 0;
+    if(bound < 1) return NI_ABOVE_BOUND;
+    // See get_NI_bounded on words that are not relabeled
+    if(memo != NULL && (NI = memo_lookup(memo, word, size)) != -1)
+	return (NI > bound)? NI_ABOVE_BOUND: NI;
+
+    refuted = memo_create(query->table_budget);
+    if(refuted == NULL) return NI_NO_MEMORY;
+    // Each step drops a letter at least, so depth size/2 always succeeds
+    NI = NI_ABOVE_BOUND;
+    for(depth = 1; depth <= bound && depth <= size/2; depth++){
+	found = search_reduction(word, size, depth, 0, memo, refuted, query);
+	if(found == -1) NI = NI_NO_MEMORY;
+	else if(found == -2) NI = NI_CANCELLED;
+	else if(found == -3){	// Depths below depth were refuted
+	    NI = NI_OVER_BUDGET;
+	    record_cut_off(stats, NI_LIMIT_TIME, depth, 0, &word, &size, 1,
+			   INT_MAX);
+	}
+	else if(found) NI = depth;
+	if(found) break;
+    }
+    memo_free(refuted);
+    if(memo != NULL && NI > 0) memo_insert(memo, word, size, NI);
+    return NI;
+}
+
+//// search_reduction function
+// Given a DOW, its size, a depth of at least 1, the level of word in search,
+// a memo table (may be NULL), a table of refuted depths and a query, returns
+// 1 if word reduces to the empty word in depth steps or less, 0 if not, -1
+// if memory could not be alloc'd, -2 if query was cancelled or -3 if word
+// hit the time limit of query. Children of word are those of step, built
+// one at a time into a single buffer: first word with maximal subwords
+// removed, which is the smallest, then word with each letter not in a
+// maximal subword removed. depth is stored for word if refuted.
+short search_reduction(unsigned short * word, int size, int depth, int level,
+		       memo_table * memo, memo_table * refuted,
+		       const ni_query * query)
+{
+    unsigned short * reduction_list[size/2 + 1];
+    unsigned short child[size + 1];
+    int partners[size + 1];
+    unsigned int in_seqs[INDEX_MASKS(size + 1)];
+    letter_index index = {partners, in_seqs};
+    int seq_count = 0, child_size = 0, i = 0;
+    short found = 0;
+
+    if(depth == 1 || size <= 4) return steps_to_empty(word, size);
+    if(QUERY_CANCELLED(query)) return -2;
+    if(QUERY_OVER_TIME(query)) return -3;
+    index_word(word, size, &index);
+    seq_count = get_repeat_return_words(word, size, reduction_list);
+    index_seqs(&index, word, size, reduction_list, seq_count);
+    if(seq_count > 0){
+	remove_seqs(word, size, &index, child, &child_size);
+	if(child_size == 0) return 1;	// Steps to empty word
+	relabel(child, child_size);
+	found = search_child(child, child_size, depth - 1, level + 1, memo,
+			     refuted, query);
+    }
+    for(i = 0; i < size && !found; i++){
+	if(partners[i] < i || IN_SEQ(&index, i)) continue;
+	remove_ltr(word, size, word[i], child);
+	relabel(child, size - 2);
+	found = search_child(child, size - 2, depth - 1, level + 1, memo,
+			     refuted, query);
+    }
+    if(found < 0) return found;
+    // Root may not be relabeled, see get_NI_bounded. A word refuted for
+    // depth - 1 that reduces in depth steps has nesting index depth.
+    if(level > 0){
+	if(!found) memo_raise(refuted, word, size, depth);
+	else if(memo != NULL &&
+		memo_lookup(refuted, word, size) == depth - 1)
+	    memo_insert(memo, word, size, depth);
+    }
+    return found;
+}
+
+//// search_child function
+// Given a relabeled child met by search_reduction with its size, the depth
+// left for it, its level and the tables and query of search_reduction,
+// returns 1 if child reduces to the empty word in depth steps or less, or
+// as search_reduction does. A child whose nesting index is in memo is
+// not searched; its nesting index answers for it. As in filter_known_words,
+// small children missing from memo are reduced in full and stored. Children
+// refuted for depth or more are skipped.
+short search_child(unsigned short * child, int size, int depth, int level,
+		   memo_table * memo, memo_table * refuted,
+		   const ni_query * query)
+{
+    ni_query unbounded = *query;
+    int NI = 0;
+
+    if(memo != NULL){
+	NI = memo_lookup(memo, child, size);
+	unbounded.bound = NI_UNBOUNDED;
+	if(NI == -1 && size <= MEMO_SMALL_SIZE)
+	    NI = get_NI_search(child, size, memo, &unbounded, NULL);
+	if(NI >= 0) return (NI <= depth);
+	if(NI == NI_NO_MEMORY) return -1;
+	if(NI == NI_CANCELLED) return -2;
+	if(NI == NI_OVER_BUDGET) return -3;
+    }
+    if(depth > 1 && memo_lookup(refuted, child, size) >= depth) return 0;
+    return search_reduction(child, size, depth, level, memo, refuted, query);
+}
+
+//// steps_to_empty function
+// Given a DOW and its size, returns 1 if one step (see step) reduces it to
+// the empty word, else 0. Cheaper than step since no children are built.
+short steps_to_empty(unsigned short * word, int size)
+{
+    unsigned short * reduction_list[size/2 + 1];
+    unsigned short reduced[size + 1];
+    int partners[size + 1];
+    unsigned int in_seqs[INDEX_MASKS(size + 1)];
+    letter_index index = {partners, in_seqs};
+    int seq_count = 0, new_size = 0;
+
+    if(size <= 4) return 1;
+    seq_count = get_repeat_return_words(word, size, reduction_list);
+    if(seq_count == 0) return 0;
+    index_word(word, size, &index);
+    index_seqs(&index, word, size, reduction_list, seq_count);
+    remove_seqs(word, size, &index, reduced, &new_size);
+    return (new_size == 0);
+}
+
+//// expand_level function
+// Given the words of a level of get_NI_parallel with their sizes and count,
+// arrays next_words and next_sizes with room for the sum of sizes/2 words,
+// jobs arenas and jobs, steps each word, storing the children without
+// duplicates in next_words. Returns the number of children stored or -1 if
+// memory could not be alloc'd. If a word steps to the empty word, the rest
+// of the level is skipped and empty_index gets its index, else -1. With one
+// job, words are stepped in order into arenas[0] and dedup is done by
+// copy_words; otherwise see level_job. Counts go to stats, which may be NULL.
+int expand_level(unsigned short ** words, int * sizes, int count,
+		 unsigned short ** next_words, int * next_sizes,
+		 word_arena * arenas, int jobs, int * empty_index,
+		 ni_stats * stats)
+{
+    level_worker_arg args[jobs];
+    work_range ranges[jobs];
+    child_list buckets[jobs*jobs], uniques[jobs];
+    level_job job;
+    int i = 0, j = 0, step_count = 0, next_count = 0, made = 0;
+
+    *empty_index = -1;
+    if(jobs == 1){
+	for(i = 0; i < count; i++){
+	    step_count = step(words[i], sizes[i], next_words + next_count,
+			      next_sizes + next_count, arenas, stats);
+	    if(step_count < 0) return -1;
+	    if(step_count == 0){
+		*empty_index = i;
+		return next_count;
+	    }
+	    next_count += step_count;
+	}
+	made = next_count;
+	if(!copy_words(next_words, next_sizes, next_words, next_sizes,
+		       &next_count))
+	    return -1;
+	STATS_ADD(stats, duplicates, made - next_count);
+	return next_count;
+    }
+
+    job.words = words;
+    job.sizes = sizes;
+    job.count = count;
+    job.jobs = jobs;
+    job.ranges = ranges;
+    job.arenas = arenas;
+    job.buckets = buckets;
+    job.uniques = uniques;
+    atomic_init(&job.next_partition, 0);
+    atomic_init(&job.found_empty, 0);
+    atomic_init(&job.empty_index, -1);
+    atomic_init(&job.out_of_memory, 0);
+    job.stats = stats;
+    memset(buckets, 0, sizeof(child_list)*jobs*jobs);
+    memset(uniques, 0, sizeof(child_list)*jobs);
+    for(i = 0; i < jobs; i++){
+	pthread_mutex_init(&ranges[i].lock, NULL);
+	ranges[i].lo = (int) ((long) count*i/jobs);
+	ranges[i].hi = (int) ((long) count*(i + 1)/jobs);
+	args[i].job = &job;
+	args[i].id = i;
+	memset(&args[i].stats, 0, sizeof(ni_stats));
+    }
+    run_threads(level_step_worker, args, sizeof(level_worker_arg), jobs);
+    if(!atomic_load(&job.found_empty) && !atomic_load(&job.out_of_memory))
+	run_threads(level_dedup_worker, args, sizeof(level_worker_arg), jobs);
+
+    // Partitions are concatenated into next level
+    for(i = 0; i < jobs && stats != NULL; i++){
+	add_stats(stats, &args[i].stats);
+	for(j = 0; j < jobs; j++) made += buckets[i*jobs + j].count;
+    }
+    for(i = 0; i < jobs; i++){
+	for(j = 0; j < uniques[i].count; j++){
+	    next_words[next_count] = uniques[i].children[j].word;
+	    next_sizes[next_count++] = uniques[i].children[j].size;
+	}
+	free(uniques[i].children);
+	pthread_mutex_destroy(&ranges[i].lock);
+    }
+    for(i = 0; i < jobs*jobs; i++) free(buckets[i].children);
+    if(atomic_load(&job.out_of_memory)) return -1;
+    *empty_index = atomic_load(&job.empty_index);
+    if(*empty_index == -1) STATS_ADD(stats, duplicates, made - next_count);
+    return next_count;
+}
+
+//// take_work function
+// Given a level job, the id of a thread and a pointer to an int, takes the
+// first word of the thread's range, stealing half of the words left in
+// another thread's range if its own is empty. Updates index with the word
+// taken and returns 1, or returns 0 if no words are left.
+short take_work(level_job * job, int id, int * index)
+{
+    work_range * own = &job->ranges[id], * victim = NULL;
+    int i = 0, lo = 0, hi = 0;
+
+    pthread_mutex_lock(&own->lock);
+    if(own->lo < own->hi){
+	*index = own->lo++;
+	pthread_mutex_unlock(&own->lock);
+	return 1;
+    }
+    pthread_mutex_unlock(&own->lock);
+    for(i = 1; i < job->jobs; i++){
+	victim = &job->ranges[(id + i) % job->jobs];
+	pthread_mutex_lock(&victim->lock);
+	hi = victim->hi;
+	lo = hi - (victim->hi - victim->lo)/2;	// Back half, rounded down
+	if(victim->lo < hi && lo == hi) lo = hi - 1;
+	victim->hi = lo;
+	pthread_mutex_unlock(&victim->lock);
+	if(lo < hi){
+	    // First stolen word is taken, rest become own range
+	    *index = lo;
+	    pthread_mutex_lock(&own->lock);
+	    own->lo = lo + 1;
+	    own->hi = hi;
+	    pthread_mutex_unlock(&own->lock);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+//// add_child function
+// Given a child list, a word, its size and its hash, appends word to list.
+// Returns 0 if memory could not be alloc'd, else 1.
+short add_child(child_list * list, unsigned short * word, int size,
+		unsigned int hash)
+{
+    level_child * children = NULL;
+    int capacity = 0;
+
+    if(list->count == list->capacity){
+	capacity = (list->capacity == 0)? 64: 2*list->capacity;
+	children = (level_child *) realloc(list->children,
+					   sizeof(level_child)*capacity);
+	if(children == NULL) return 0;
+	list->children = children;
+	list->capacity = capacity;
+    }
+    list->children[list->count].word = word;
+    list->children[list->count].size = size;
+    list->children[list->count++].hash = hash;
+    return 1;
+}
+
+//// level_step_worker function
+// Thread routine for the first phase of expand_level. Given a
+// level_worker_arg, steps words taken with take_work into the thread's arena
+// and files children in the thread's buckets by the high bits of their hash.
+// Stops as soon as any thread steps to the empty word or runs out of memory.
+void * level_step_worker(void * arg)
+{
+    level_worker_arg * worker = (level_worker_arg *) arg;
+    level_job * job = worker->job;
+    child_list * buckets = job->buckets + worker->id*job->jobs;
+    unsigned int hash = 0;
+    int i = 0, j = 0, step_count = 0, expected = -1;
+
+    while(!atomic_load_explicit(&job->found_empty, memory_order_relaxed) &&
+	  !atomic_load_explicit(&job->out_of_memory, memory_order_relaxed) &&
+	  take_work(job, worker->id, &i)){
+	unsigned short * children[job->sizes[i]/2];
+	int sizes[job->sizes[i]/2];
+
+	step_count = step(job->words[i], job->sizes[i], children, sizes,
+			  &job->arenas[worker->id],
+			  (job->stats != NULL)? &worker->stats: NULL);
+	if(step_count == 0){
+	    expected = -1;
+	    atomic_compare_exchange_strong(&job->empty_index, &expected, i);
+	    atomic_store(&job->found_empty, 1);
+	}
+	for(j = 0; j < step_count; j++){
+	    hash = hash_word(children[j], sizes[j]);
+	    if(!add_child(&buckets[((unsigned long long) hash*job->jobs) >> 32],
+			  children[j], sizes[j], hash))
+		step_count = -1;
+	}
+	if(step_count < 0) atomic_store(&job->out_of_memory, 1);
+    }
+    return NULL;
+}
+
+//// level_dedup_worker function
+// Thread routine for the second phase of expand_level. Given a
+// level_worker_arg, takes partitions not yet taken and copies the children
+// filed in them by all threads into the partition's unique list, without
+// duplicates. The same open-addressing scheme as copy_words is used.
+void * level_dedup_worker(void * arg)
+{
+    level_job * job = ((level_worker_arg *) arg)->job;
+    child_list * bucket = NULL, * unique = NULL;
+    level_child * child = NULL, * kept = NULL;
+    int * table = NULL;
+    unsigned int mask = 0, slot = 0;
+    int p = 0, t = 0, i = 0, total = 0;
+    short isDup = 0;
+
+    while((p = atomic_fetch_add(&job->next_partition, 1)) < job->jobs){
+	unique = &job->uniques[p];
+	total = 0;
+	for(t = 0; t < job->jobs; t++) total += job->buckets[t*job->jobs + p].count;
+	if(total == 0) continue;
+	for(mask = 1; mask < 2*(unsigned int) total; mask <<= 1);
+	table = (int *) malloc(sizeof(int)*mask);
+	unique->children = (level_child *) malloc(sizeof(level_child)*total);
+	if(table == NULL || unique->children == NULL){
+	    free(table);
+	    atomic_store(&job->out_of_memory, 1);
+	    return NULL;
+	}
+	unique->capacity = total;
+	for(i = 0; i < (int) mask; i++) table[i] = -1;
+	mask--;
+	for(t = 0; t < job->jobs; t++){
+	    bucket = &job->buckets[t*job->jobs + p];
+	    for(i = 0; i < bucket->count; i++){
+		child = &bucket->children[i];
+		isDup = 0;
+		for(slot = child->hash & mask; table[slot] != -1 && !isDup;
+		    slot = (slot + 1) & mask){
+		    kept = &unique->children[table[slot]];
+		    isDup = (kept->hash == child->hash &&
+			     kept->size == child->size &&
+			     memcmp(kept->word, child->word,
+				    sizeof(unsigned short)*child->size) == 0);
+		}
+		if(!isDup){
+		    table[slot] = unique->count;
+		    unique->children[unique->count++] = *child;
+		}
+	    }
+	}
+	free(table);
+    }
+    return NULL;
+}
+
+//// filter_known_words function
+// Given a memo table, the words of a level of get_NI with their sizes and
+// count, the level (number of steps taken to reach words) and the best bound
+// on the nesting index so far, removes words found in memo from the level and
+// returns the bound improved by them. Words of size at most MEMO_SMALL_SIZE
+// missing from memo are reduced on their own first: there are few of them,
+// so they soon are all in memo. Does nothing if memo is NULL.
+int filter_known_words(memo_table * memo, unsigned short ** words, int * sizes,
+		       int * count, int level, int best)
+{
+    int i = 0, ctr = 0, NI = 0;
+
+    if(memo == NULL) return best;
+    for(i = 0; i < *count; i++){
+	NI = memo_lookup(memo, words[i], sizes[i]);
+	if(NI == -1 && sizes[i] <= MEMO_SMALL_SIZE)
+	    NI = get_NI(words[i], sizes[i], memo);
+	if(NI < 0){	// Unknown or out of memory, word stays in level
+	    words[ctr] = words[i];
+	    sizes[ctr++] = sizes[i];
+	}
+	else if(level + NI < best)
+	    best = level + NI;
+    }
+    *count = ctr;
+    return best;
+}
+
+//// copy_words function
+// Copies words from source to destination without copying duplicates; dest
+// may be the same array as source. Words already copied are remembered in an
+// open-addressing hash table (linear probing) holding their indices in dest,
+// so each source word is compared only against the dest words sharing its
+// hash slot chain. Returns 0 if memory could not be alloc'd for the table,
+// else 1.
+short copy_words(unsigned short ** dest, int * dest_sizes,
+		unsigned short ** source, int * source_sizes, int * count)
+{
+    int * table = NULL;
+    unsigned int * hashes = NULL;
+    unsigned int hash = 0, mask = 0, slot = 0;
+    int i = 0, j = 0, ctr = 0;
+    short isInDest = 0;
+
+    // Table gets at least twice as many slots as words to keep chains short
+    mask = 1;
+    while(mask < 2*(unsigned int)(*count)) mask <<= 1;
+    table = (int *) malloc(sizeof(int)*mask);
+    hashes = (unsigned int *) malloc(sizeof(unsigned int)*(*count + 1));
+    if(table == NULL || hashes == NULL){
+	if(table != NULL) free(table);
+	if(hashes != NULL) free(hashes);
+	return 0;
+    }
+    for(i = 0; i < (int) mask; i++) table[i] = -1;
+    mask--;
+
+    for(i = 0; i < *count; i++){
+	hash = hash_word(source[i], source_sizes[i]);
+	isInDest = 0;
+	for(slot = hash & mask; (j = table[slot]) != -1 && !isInDest;
+	    slot = (slot + 1) & mask){
+	    if(hashes[j] == hash && source_sizes[i] == dest_sizes[j]){
+		isInDest = \
+		    (memcmp(source[i], dest[j], sizeof(short)*(dest_sizes[j])) == 0);
+	    }
+	}
+	if(!isInDest){	// Add seq to dest and remember it in table
+	    table[slot] = ctr;
+	    hashes[ctr] = hash;
+	    dest[ctr] = source[i];
+	    dest_sizes[ctr] = source_sizes[i];
+	    ctr++;
+	}
+    }
+    free(table);
+    free(hashes);
+    *count = ctr;
+    return 1;
+}
+
+//// merge_class_words function
+// Given the words of a level of get_NI_class with their sizes, masks
+// (mask_words elements each) and count, and the mask of words of class
+// settled, drops words whose masks hold only settled words and keeps one
+// copy of each other word, in place, whose mask is the union of the masks
+// of its copies. Duplicates are found as in copy_words. Returns 0 if memory
+// could not be alloc'd for the table, else 1.
+short merge_class_words(unsigned short ** words, int * sizes,
+			unsigned long long * masks, int mask_words,
+			unsigned long long * done, int * count)
+{
+    unsigned long long * mask = NULL;
+    int * table = NULL;
+    unsigned int * hashes = NULL;
+    unsigned int hash = 0, table_mask = 0, slot = 0;
+    int i = 0, j = 0, k = 0, ctr = 0;
+    short isOpen = 0;
+
+    table_mask = 1;
+    while(table_mask < 2*(unsigned int)(*count)) table_mask <<= 1;
+    table = (int *) malloc(sizeof(int)*table_mask);
+    hashes = (unsigned int *) malloc(sizeof(unsigned int)*(*count + 1));
+    if(table == NULL || hashes == NULL){
+	free(table);
+	free(hashes);
+	return 0;
+    }
+    for(i = 0; i < (int) table_mask; i++) table[i] = -1;
+    table_mask--;
+
+    for(i = 0; i < *count; i++){
+	mask = masks + (size_t) i*mask_words;
+	isOpen = 0;
+	for(k = 0; k < mask_words; k++){
+	    mask[k] &= ~done[k];
+	    if(mask[k] != 0) isOpen = 1;
+	}
+	if(!isOpen) continue;
+	hash = hash_word(words[i], sizes[i]);
+	for(slot = hash & table_mask; (j = table[slot]) != -1;
+	    slot = (slot + 1) & table_mask){
+	    if(hashes[j] == hash && sizes[i] == sizes[j] &&
+	       memcmp(words[i], words[j], sizeof(unsigned short)*sizes[j]) == 0)
+		break;
+	}
+	if(j != -1){	// Copy kept at j gets the words of mask too
+	    for(k = 0; k < mask_words; k++)
+		masks[(size_t) j*mask_words + k] |= mask[k];
+	    continue;
+	}
+	table[slot] = ctr;
+	hashes[ctr] = hash;
+	words[ctr] = words[i];
+	sizes[ctr] = sizes[i];
+	memmove(masks + (size_t) ctr*mask_words, mask,
+		sizeof(unsigned long long)*mask_words);
+	ctr++;
+    }
+    free(table);
+    free(hashes);
+    *count = ctr;
+    return 1;
+}
+
+//// hash_word function
+// Given a word and its size, returns a hash of the word (FNV-1a over the
+// letters). Words equal letter for letter always get equal hashes.
+unsigned int hash_word(unsigned short * word, int size)
+{
+    unsigned int hash = 2166136261u;
+    int i = 0;
+
+    for(i = 0; i < size; i++){
+	hash ^= word[i];
+	hash *= 16777619u;
+    }
+    hash ^= (unsigned int) size;
+    hash *= 16777619u;
+    return hash;
+}
+
+
+//// arena_init function
+// Given an arena, makes it empty. No memory is alloc'd until first use.
+void arena_init(word_arena * arena)
+{
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+//// arena_alloc function
+// Given an arena and a number of letters, returns room for that many letters
+// from arena, or NULL if memory could not be alloc'd. Room is taken from the
+// current block, else from the next block kept from before a reset, else from
+// a new block twice as large as the last.
+unsigned short * arena_alloc(word_arena * arena, int count)
+{
+    arena_block * block = arena->current, * new_block = NULL;
+    size_t capacity = ARENA_MIN_LETTERS;
+    unsigned short * room = NULL;
+
+    if(block == NULL || block->used + count > block->capacity){
+	if(block != NULL && block->next != NULL &&
+	   (size_t) count <= block->next->capacity){
+	    block = block->next;
+	}
+	else{
+	    if(block != NULL && 2*block->capacity <= ARENA_MAX_LETTERS)
+		capacity = 2*block->capacity;
+	    else if(block != NULL)
+		capacity = block->capacity;
+	    if(capacity < (size_t) count) capacity = count;
+	    new_block = (arena_block *) malloc(sizeof(arena_block) + \
+					       sizeof(unsigned short)*capacity);
+	    if(new_block == NULL) return NULL;
+	    new_block->capacity = capacity;
+	    new_block->used = 0;
+	    if(block == NULL){
+		new_block->next = arena->first;
+		arena->first = new_block;
+	    }
+	    else{
+		new_block->next = block->next;
+		block->next = new_block;
+	    }
+	    block = new_block;
+	}
+	arena->current = block;
+    }
+    room = block->letters + block->used;
+    block->used += count;
+    return room;
+}
+
+//// arena_reset function
+// Given an arena, frees all words alloc'd from it at once. Blocks are kept.
+void arena_reset(word_arena * arena)
+{
+    arena_block * block = NULL;
+
+    for(block = arena->first; block != NULL; block = block->next)
+	block->used = 0;
+    arena->current = arena->first;
+}
+
+//// arena_release function
+// Given an arena, frees its blocks, leaving it empty.
+void arena_release(word_arena * arena)
+{
+    arena_block * block = arena->first, * next = NULL;
+
+    while(block != NULL){
+	next = block->next;
+	free(block);
+	block = next;
+    }
+    arena_init(arena);
+}
+
+//// arena_letters function
+// Given an arena, returns the number of letters its blocks have room for.
+size_t arena_letters(word_arena * arena)
+{
+    arena_block * block = NULL;
+    size_t letters = 0;
+
+    for(block = arena->first; block != NULL; block = block->next)
+	letters += block->capacity;
+    return letters;
+}
+
+//// memo_create function
+// Given a budget in bytes, returns an empty memo table that will use at most
+// about that much memory, or NULL if memory could not be alloc'd.
+memo_table * memo_create(size_t budget)
+{
+    memo_table * memo = (memo_table *) malloc(sizeof(memo_table));
+
+    if(memo == NULL) return NULL;
+    memo->capacity = MEMO_MIN_SLOTS;
+    memo->slots = (memo_entry *) calloc(memo->capacity, sizeof(memo_entry));
+    if(memo->slots == NULL){
+	free(memo);
+	return NULL;
+    }
+    memo->count = 0;
+    memo->hand = 0;
+    memo->bytes = sizeof(memo_entry)*memo->capacity;
+    memo->budget = budget;
+    memo->hits = memo->misses = memo->evictions = 0;
+    memo->shared = NULL;
+    memo->db = NULL;
+    memo->pending = NULL;
+    memo->pending_count = 0;
+    arena_init(&memo->pending_arena);
+    memo->db_hits = memo->db_misses = 0;
+    memo->spare_arenas = NULL;
+    memo->spare_count = memo->spare_room = 0;
+    return memo;
+}
+
+//// memo_free function
+// Frees memo table and all words stored in it
+void memo_free(memo_table * memo)
+{
+    unsigned int i = 0;
+
+    if(memo == NULL) return;
+    memo_flush(memo);
+    for(i = 0; i < memo->capacity; i++)
+	if(memo->slots[i].word != NULL) free(memo->slots[i].word);
+    free(memo->slots);
+    free(memo->pending);
+    arena_release(&memo->pending_arena);
+    for(i = 0; i < (unsigned int) memo->spare_count; i++)
+	arena_release(&memo->spare_arenas[i]);
+    free(memo->spare_arenas);
+    free(memo);
+}
+
+//// memo_find function
+// Given memo table, a word, its size and its hash, returns slot holding word
+// or, if word is not in memo, the empty slot where it would be inserted.
+unsigned int memo_find(memo_table * memo, unsigned short * word,
+			      int size, unsigned int hash)
+{
+    unsigned int mask = memo->capacity - 1, slot = hash & mask;
+    memo_entry * entry;
+
+    while((entry = &memo->slots[slot])->word != NULL){
+	if(entry->hash == hash && entry->size == size &&
+	   memcmp(entry->word, word, sizeof(unsigned short)*size) == 0)
+	    break;
+	slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+//// memo_lookup function
+// Given memo table, a word and its size, returns nesting index of
+// word stored in memo or -1 if word is not in memo. Words missing from memo
+// are looked up in its shared memo and then in its database, if any, and
+// stored in memo if found; words found in database go to shared memo too.
+int memo_lookup(memo_table * memo, unsigned short * word, int size)
+{
+    unsigned int hash = hash_word(word, size);
+    memo_entry * entry;
+    int NI = 0;
+
+    entry = &memo->slots[memo_find(memo, word, size, hash)];
+    if(entry->word == NULL){
+	memo->misses++;
+	if(memo->shared != NULL &&
+	   (NI = shared_memo_lookup(memo->shared, word, size, hash)) != -1){
+	    memo_store(memo, word, size, hash, NI);
+	    return NI;
+	}
+	if(memo->db == NULL) return -1;
+	NI = db_lookup(memo->db, word, size, hash);
+	if(NI == -1){
+	    memo->db_misses++;
+	    return -1;
+	}
+	memo->db_hits++;
+	memo_store(memo, word, size, hash, NI);
+	if(memo->shared != NULL)
+	    shared_memo_insert(memo->shared, word, size, hash, NI);
+	return NI;
+    }
+    memo->hits++;
+    entry->ref = 1;
+    return entry->NI;
+}
+
+//// memo_remove_slot function
+// Empties slot of memo table, shifting back later entries of its probe chain
+// so that linear probing still finds them.
+void memo_remove_slot(memo_table * memo, unsigned int slot)
+{
+    unsigned int mask = memo->capacity - 1, next = 0, home = 0;
+
+    memo->bytes -= sizeof(unsigned short)*memo->slots[slot].size;
+    free(memo->slots[slot].word);
+    memo->slots[slot].word = NULL;
+    memo->count--;
+    next = (slot + 1) & mask;
+    while(memo->slots[next].word != NULL){
+	home = memo->slots[next].hash & mask;
+	// Entry may move to slot if slot lies cyclically in [home, next)
+	if(((next - home) & mask) >= ((next - slot) & mask)){
+	    memo->slots[slot] = memo->slots[next];
+	    memo->slots[next].word = NULL;
+	    slot = next;
+	}
+	next = (next + 1) & mask;
+    }
+}
+
+//// memo_evict function
+// Advances clock hand of memo table, giving entries with reference bit set a
+// second chance, and evicts the first entry without it.
+void memo_evict(memo_table * memo)
+{
+    memo_entry * entry;
+
+    while(memo->count > 0){
+	entry = &memo->slots[memo->hand];
+	if(entry->word != NULL){
+	    if(!entry->ref){
+		memo_remove_slot(memo, memo->hand);
+		memo->evictions++;
+		// Hand stays, slot may have been refilled by backward shift
+		return;
+	    }
+	    entry->ref = 0;
+	}
+	memo->hand = (memo->hand + 1) & (memo->capacity - 1);
+    }
+}
+
+//// memo_grow function
+// Doubles number of slots in memo table, rehashing entries. Returns 0 if it
+// would exceed budget or memory could not be alloc'd, else 1.
+short memo_grow(memo_table * memo)
+{
+    memo_entry * old_slots = memo->slots, * new_slots = NULL;
+    unsigned int old_capacity = memo->capacity, i = 0, slot = 0, mask = 0;
+    size_t extra = sizeof(memo_entry)*old_capacity;
+
+    if(memo->bytes + extra > memo->budget) return 0;
+    new_slots = (memo_entry *) calloc(2*old_capacity, sizeof(memo_entry));
+    if(new_slots == NULL) return 0;
+    memo->slots = new_slots;
+    memo->capacity = 2*old_capacity;
+    memo->hand = 0;
+    memo->bytes += extra;
+    mask = memo->capacity - 1;
+    for(i = 0; i < old_capacity; i++){
+	if(old_slots[i].word == NULL) continue;
+	for(slot = old_slots[i].hash & mask; new_slots[slot].word != NULL;
+	    slot = (slot + 1) & mask);
+	new_slots[slot] = old_slots[i];
+    }
+    free(old_slots);
+    return 1;
+}
+
+//// memo_insert function
+// Given memo table, a word, its size and its nesting index, stores
+// word with its nesting index (see memo_store) unless it is there already.
+// Word is also added to the shared memo of memo, if any, unless it is there.
+// If memo has a database, word is also queued for it; queued words are added
+// once DB_BATCH_WORDS of them are waiting, or by memo_flush.
+void memo_insert(memo_table * memo, unsigned short * word, int size, int NI)
+{
+    unsigned int hash = hash_word(word, size);
+
+    if(memo->slots[memo_find(memo, word, size, hash)].word != NULL) return;
+    memo_queue(memo, word, size, hash, NI);
+    memo_store(memo, word, size, hash, NI);
+    if(memo->shared != NULL)
+	shared_memo_insert(memo->shared, word, size, hash, NI);
+}
+
+//// memo_queue function
+// Given memo table, a word, its size, its hash and its nesting index, queues
+// a copy of word for the database of memo. Does nothing if memo has no
+// database or its database is read-only.
+void memo_queue(memo_table * memo, unsigned short * word, int size,
+		unsigned int hash, int NI)
+{
+    db_entry * entry = NULL;
+
+    if(memo->db == NULL || memo->db->read_only) return;
+    entry = &memo->pending[memo->pending_count];
+    // +1 so that the empty word gets memory too
+    entry->word = arena_alloc(&memo->pending_arena, size + 1);
+    if(entry->word == NULL) return;	// Database is only a cache
+    memcpy(entry->word, word, sizeof(unsigned short)*size);
+    entry->size = size;
+    entry->NI = NI;
+    entry->hash = hash;
+    if(++memo->pending_count == DB_BATCH_WORDS) memo_flush(memo);
+}
+
+//// memo_store function
+// Given memo table, a word that is not in memo, its size, its
+// hash and its nesting index, stores a copy of word with its nesting index.
+// Entries are evicted as needed to stay within budget; word is not stored if
+// it alone exceeds budget.
+void memo_store(memo_table * memo, unsigned short * word, int size,
+		unsigned int hash, int NI)
+{
+    size_t word_bytes = sizeof(unsigned short)*size;
+    unsigned int slot = 0;
+    unsigned short * copy = NULL;
+
+    if(sizeof(memo_entry)*memo->capacity + word_bytes > memo->budget) return;
+    // Keeps load factor at most 1/2, growing table while budget allows
+    while(2*(memo->count + 1) > memo->capacity && !memo_grow(memo))
+	memo_evict(memo);
+    while(memo->bytes + word_bytes > memo->budget && memo->count > 0)
+	memo_evict(memo);
+
+    copy = (unsigned short *) malloc(word_bytes);
+    if(copy == NULL) return;	// Memo is only a cache, skip storing
+    memcpy(copy, word, word_bytes);
+    slot = memo_find(memo, word, size, hash);
+    memo->slots[slot].word = copy;
+    memo->slots[slot].size = size;
+    memo->slots[slot].NI = NI;
+    memo->slots[slot].hash = hash;
+    memo->slots[slot].ref = 0;
+    memo->count++;
+    memo->bytes += word_bytes;
+}
+
+//// memo_raise function
+// Given memo table, a word, its size and a value, stores value for
+// word as memo_insert does, or raises the value stored for word to value if
+// it is less.
+void memo_raise(memo_table * memo, unsigned short * word, int size, int value)
+{
+    memo_entry * entry;
+
+    entry = &memo->slots[memo_find(memo, word, size, hash_word(word, size))];
+    if(entry->word == NULL) memo_insert(memo, word, size, value);
+    else if(entry->NI < value) entry->NI = value;
+}
+
+//// memo_take_arenas function
+// Given memo table (may be NULL) and count arenas, gives them the spare
+// arenas of memo, making the arenas left over empty and releasing spare
+// arenas beyond count. Spare arenas are taken by one call at a time; calls
+// nested in it, as by filter_known_words, get empty arenas.
+void memo_take_arenas(memo_table * memo, word_arena * arenas, int count)
+{
+    int i = 0, spares = (memo != NULL)? memo->spare_count: 0;
+
+    for(i = 0; i < count; i++){
+	if(i < spares) arenas[i] = memo->spare_arenas[i];
+	else arena_init(&arenas[i]);
+    }
+    for(i = count; i < spares; i++) arena_release(&memo->spare_arenas[i]);
+    if(memo != NULL) memo->spare_count = 0;
+}
+
+//// memo_keep_arenas function
+// Given memo table (may be NULL) and count arenas, resets them and keeps
+// them as the spare arenas of memo. Arenas are released instead if memo
+// already keeps some, room for them could not be alloc'd, or they hold more
+// than ARENA_SPARE_LETTERS letters.
+void memo_keep_arenas(memo_table * memo, word_arena * arenas, int count)
+{
+    word_arena * room = NULL;
+    size_t letters = 0;
+    int i = 0;
+
+    for(i = 0; i < count; i++) letters += arena_letters(&arenas[i]);
+    if(memo != NULL && memo->spare_count == 0 &&
+       letters <= ARENA_SPARE_LETTERS){
+	if(memo->spare_room < count){
+	    room = (word_arena *) realloc(memo->spare_arenas,
+					  sizeof(word_arena)*count);
+	    if(room != NULL){
+		memo->spare_arenas = room;
+		memo->spare_room = count;
+	    }
+	}
+	if(memo->spare_room >= count){
+	    for(i = 0; i < count; i++) arena_reset(&arenas[i]);
+	    memcpy(memo->spare_arenas, arenas, sizeof(word_arena)*count);
+	    memo->spare_count = count;
+	    return;
+	}
+    }
+    for(i = 0; i < count; i++) arena_release(&arenas[i]);
+}
+
+//// memo_attach_db function
+// Given memo table and a database, puts database behind memo. Returns 0 if
+// memory could not be alloc'd, else 1.
+short memo_attach_db(memo_table * memo, ni_db * db)
+{
+    memo->pending = (db_entry *) malloc(sizeof(db_entry)*DB_BATCH_WORDS);
+    if(memo->pending == NULL) return 0;
+    memo->db = db;
+    return 1;
+}
+
+//// memo_flush function
+// Given memo table, adds the words it has queued to its database.
+void memo_flush(memo_table * memo)
+{
+    if(memo->pending_count == 0) return;
+    db_insert(memo->db, memo->pending, memo->pending_count);
+    memo->pending_count = 0;
+    arena_reset(&memo->pending_arena);
+}
+
+//// shared_memo_create function
+// Given a budget in bytes, returns an empty shared memo that will use at
+// most about that much memory, split evenly among its stripes, or NULL if
+// memory could not be alloc'd.
+shared_memo * shared_memo_create(size_t budget)
+{
+    shared_memo * shared = NULL;
+    int i = 0;
+
+    if(posix_memalign((void **) &shared, sizeof(memo_stripe),
+		      sizeof(shared_memo)) != 0)
+	return NULL;
+    for(i = 0; i < SHARED_MEMO_STRIPES; i++){
+	pthread_mutex_init(&shared->stripes[i].lock, NULL);
+	shared->stripes[i].table = memo_create(budget/SHARED_MEMO_STRIPES);
+	if(shared->stripes[i].table == NULL){
+	    while(i >= 0){
+		memo_free(shared->stripes[i].table);
+		pthread_mutex_destroy(&shared->stripes[i--].lock);
+	    }
+	    free(shared);
+	    return NULL;
+	}
+    }
+    return shared;
+}
+
+//// shared_memo_free function
+// Frees shared memo (may be NULL) and all words stored in it. No thread may
+// be using it.
+void shared_memo_free(shared_memo * shared)
+{
+    int i = 0;
+
+    if(shared == NULL) return;
+    for(i = 0; i < SHARED_MEMO_STRIPES; i++){
+	memo_free(shared->stripes[i].table);
+	pthread_mutex_destroy(&shared->stripes[i].lock);
+    }
+    free(shared);
+}
+
+//// shared_memo_lookup function
+// Given a shared memo, a word, its size and its hash, returns nesting index
+// of word stored in shared memo or -1 if word is not in it. Only the stripe
+// of word is locked.
+int shared_memo_lookup(shared_memo * shared, unsigned short * word, int size,
+		       unsigned int hash)
+{
+    memo_stripe * stripe = &shared->stripes[hash >> SHARED_MEMO_SHIFT];
+    memo_table * table = stripe->table;
+    memo_entry * entry;
+    int NI = -1;
+
+    pthread_mutex_lock(&stripe->lock);
+    entry = &table->slots[memo_find(table, word, size, hash)];
+    if(entry->word == NULL) table->misses++;
+    else{
+	table->hits++;
+	entry->ref = 1;
+	NI = entry->NI;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    return NI;
+}
+
+//// shared_memo_insert function
+// Given a shared memo, a word, its size, its hash and its nesting index,
+// stores word with its nesting index in the stripe of word unless it is
+// there already, evicting entries of the stripe as memo_store does.
+void shared_memo_insert(shared_memo * shared, unsigned short * word,
+			int size, unsigned int hash, int NI)
+{
+    memo_stripe * stripe = &shared->stripes[hash >> SHARED_MEMO_SHIFT];
+    memo_table * table = stripe->table;
+
+    pthread_mutex_lock(&stripe->lock);
+    if(table->slots[memo_find(table, word, size, hash)].word == NULL)
+	memo_store(table, word, size, hash, NI);
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+//// shared_memo_counts function
+// Given a shared memo and counts, stores the combined hit, miss and
+// eviction counts, entries and bytes of its stripes in the shared counts.
+void shared_memo_counts(shared_memo * shared, ni_memo_counts * counts)
+{
+    memo_table * table = NULL;
+    int i = 0;
+
+    for(i = 0; i < SHARED_MEMO_STRIPES; i++){
+	pthread_mutex_lock(&shared->stripes[i].lock);
+	table = shared->stripes[i].table;
+	counts->shared_hits += table->hits;
+	counts->shared_misses += table->misses;
+	counts->shared_evictions += table->evictions;
+	counts->shared_entries += table->count;
+	counts->shared_bytes += table->bytes;
+	pthread_mutex_unlock(&shared->stripes[i].lock);
+    }
+}
+
+//// db_open function
+// Given the path of an NI database, read_only and a pointer to a handle,
+// opens database, laying out an empty one in a new file unless read_only,
+// and points db to its handle. Returns NI_OK, NI_BAD_DATABASE if file could
+// not be opened or is not an NI database, or NI_NO_MEMORY.
+int db_open(const char * path, short read_only, ni_db ** db)
+{
+    ni_db * handle = NULL;
+    db_map * map = NULL;
+    struct stat info;
+    int fd = -1;
+
+    fd = open(path, read_only? O_RDONLY: O_RDWR | O_CREAT, 0644);
+    if(fd == -1) return NI_BAD_DATABASE;
+    // A new file is laid out by the first writer to lock it
+    if(!read_only){
+	if(flock(fd, LOCK_EX) != 0 || fstat(fd, &info) != 0 ||
+	   (info.st_size == 0 &&
+	    !db_init_file(fd, DB_MIN_SLOTS, DB_MIN_LETTERS))){
+	    close(fd);
+	    return NI_BAD_DATABASE;
+	}
+	flock(fd, LOCK_UN);
+    }
+    map = db_map_file(fd, read_only);
+    handle = (ni_db *) malloc(sizeof(ni_db));
+    if(handle != NULL) handle->path = strdup(path);
+    if(map == NULL || handle == NULL || handle->path == NULL){
+	if(map != NULL){
+	    munmap(map->base, map->length);
+	    free(map);
+	}
+	if(handle != NULL) free(handle->path);
+	free(handle);
+	close(fd);
+	return (map == NULL)? NI_BAD_DATABASE: NI_NO_MEMORY;
+    }
+    handle->fd = fd;
+    handle->read_only = read_only;
+    atomic_init(&handle->map, map);
+    pthread_mutex_init(&handle->lock, NULL);
+    *db = handle;
+    return NI_OK;
+}
+
+//// db_close function
+// Given a database handle (may be NULL), unmaps its files and frees it.
+void db_close(ni_db * db)
+{
+    db_map * map = NULL, * next = NULL;
+
+    if(db == NULL) return;
+    for(map = atomic_load(&db->map); map != NULL; map = next){
+	next = map->next;
+	munmap(map->base, map->length);
+	free(map);
+    }
+    close(db->fd);
+    pthread_mutex_destroy(&db->lock);
+    free(db->path);
+    free(db);
+}
+
+//// db_init_file function
+// Given an empty file, lays out an empty database with capacity slots and
+// room letters in it. Returns 0 if file could not be written, else 1.
+short db_init_file(int fd, unsigned long long capacity,
+		   unsigned long long room)
+{
+    db_header header;
+
+    memset(&header, 0, sizeof(db_header));
+    memcpy(header.magic, DB_MAGIC, sizeof(header.magic));
+    header.capacity = capacity;
+    header.room = room;
+    // Slots and letters are holes until written, which read as empty
+    return ftruncate(fd, DB_HEADER_BYTES + capacity*sizeof(db_slot) +
+		     room*sizeof(unsigned short)) == 0 &&
+	pwrite(fd, &header, sizeof(db_header), 0) == sizeof(db_header);
+}
+
+//// db_map_file function
+// Given a database file and read_only, checks its header and maps it, for
+// writing too unless read_only. Returns the map, or NULL if file is not a
+// database or could not be mapped.
+db_map * db_map_file(int fd, short read_only)
+{
+    db_header header;
+    db_map * map = NULL;
+    struct stat info;
+
+    if(fstat(fd, &info) != 0 || info.st_size < DB_HEADER_BYTES ||
+       pread(fd, &header, sizeof(db_header), 0) != sizeof(db_header) ||
+       memcmp(header.magic, DB_MAGIC, sizeof(header.magic)) != 0 ||
+       header.capacity == 0 || header.capacity > DB_MAX_SLOTS ||
+       (header.capacity & (header.capacity - 1)) != 0 ||
+       header.room > DB_MAX_LETTERS ||
+       (unsigned long long) info.st_size < DB_HEADER_BYTES +
+       header.capacity*sizeof(db_slot) + header.room*sizeof(unsigned short))
+	return NULL;
+    map = (db_map *) malloc(sizeof(db_map));
+    if(map == NULL) return NULL;
+    map->length = info.st_size;
+    map->base = mmap(NULL, map->length,
+		     read_only? PROT_READ: PROT_READ | PROT_WRITE, MAP_SHARED,
+		     fd, 0);
+    if(map->base == MAP_FAILED){
+	free(map);
+	return NULL;
+    }
+    map->next = NULL;
+    map->header = (db_header *) map->base;
+    map->slots = (db_slot *) (map->base + DB_HEADER_BYTES);
+    map->letters = (unsigned short *) (map->slots + header.capacity);
+    map->capacity = header.capacity;
+    map->room = header.room;
+    return map;
+}
+
+//// db_find function
+// Given a map of a database, a word, its size and its hash,
+// returns slot holding word or, if word is not in map, the empty slot where
+// it would be added. Returns map->capacity if there is neither, which only
+// happens in a damaged file. Safe while a writer adds words.
+unsigned long long db_find(db_map * map, unsigned short * word, int size,
+			   unsigned int hash)
+{
+    unsigned long long mask = map->capacity - 1, slot = hash & mask, i = 0;
+    unsigned int position = 0;
+    db_slot * entry = NULL;
+
+    for(i = 0; i < map->capacity; i++, slot = (slot + 1) & mask){
+	entry = &map->slots[slot];
+	position = atomic_load_explicit(&entry->position,
+					memory_order_acquire);
+	if(position == 0) return slot;
+	if(entry->hash == hash && entry->size == (unsigned int) size &&
+	   position - 1 + (unsigned long long) size <= map->room &&
+	   memcmp(map->letters + position - 1, word,
+		  sizeof(unsigned short)*size) == 0)
+	    return slot;
+    }
+    return map->capacity;
+}
+
+//// db_lookup function
+// Given a database, a word, its size and its hash, returns the
+// nesting index of word stored in database or -1 if word is not in it.
+int db_lookup(ni_db * db, unsigned short * word, int size, unsigned int hash)
+{
+    db_map * map = atomic_load_explicit(&db->map, memory_order_acquire);
+    unsigned long long slot = db_find(map, word, size, hash);
+
+    if(slot == map->capacity ||
+       atomic_load_explicit(&map->slots[slot].position,
+			    memory_order_relaxed) == 0 ||
+       map->slots[slot].NI < 1)
+	return -1;
+    return map->slots[slot].NI;
+}
+
+//// db_insert function
+// Given a database and count words waiting for it, adds those not yet in
+// it, growing it as needed. Words that do not fit once database cannot grow
+// are dropped, as database is only a cache.
+void db_insert(ni_db * db, db_entry * entries, int count)
+{
+    db_map * map = NULL;
+    unsigned long long slot = 0;
+    int i = 0;
+
+    if(!db_lock(db)) return;
+    for(i = 0; i < count; i++){
+	map = atomic_load_explicit(&db->map, memory_order_relaxed);
+	slot = db_find(map, entries[i].word, entries[i].size, entries[i].hash);
+	if(slot < map->capacity &&
+	   atomic_load_explicit(&map->slots[slot].position,
+				memory_order_relaxed) != 0)
+	    continue;	// Added by another run
+	if(slot == map->capacity ||
+	   2*(atomic_load(&map->header->count) + 1) > map->capacity ||
+	   map->header->used > map->room ||
+	   (unsigned long long) entries[i].size >
+	   map->room - map->header->used){
+	    if(!db_grow(db, entries[i].size)) break;
+	    map = atomic_load_explicit(&db->map, memory_order_relaxed);
+	    slot = db_find(map, entries[i].word, entries[i].size,
+			   entries[i].hash);
+	}
+	db_store(map, slot, &entries[i]);
+    }
+    db_unlock(db);
+}
+
+//// db_store function
+// Given a locked map with room for entry and the empty slot for entry,
+// stores entry there. The letters and fields of slot are written before its
+// position, which publishes it to readers.
+void db_store(db_map * map, unsigned long long slot, db_entry * entry)
+{
+    db_slot * target = &map->slots[slot];
+    unsigned long long position = map->header->used;
+
+    memcpy(map->letters + position, entry->word,
+	   sizeof(unsigned short)*entry->size);
+    map->header->used = position + entry->size;
+    target->hash = entry->hash;
+    target->size = entry->size;
+    target->NI = entry->NI;
+    atomic_store_explicit(&target->position, (unsigned int) position + 1,
+			  memory_order_release);
+    atomic_fetch_add(&map->header->count, 1);
+}
+
+//// db_grow function
+// Given a locked database and the size of a word about to be added, copies
+// the entries of database into a new file, at least as large as the old one,
+// with its slots at most a third full and its letters at most three quarters
+// used once the word is added, then renames it over the old file. Letters
+// of entries never published, as by a writer that died, are dropped. Returns
+// 0 if database cannot grow or the new file could not be made, else 1.
+short db_grow(ni_db * db, int size)
+{
+    db_map * old = atomic_load(&db->map), * map = NULL;
+    unsigned long long capacity = old->capacity, room = old->room;
+    unsigned long long live = 0, count = 0, slot = 0;
+    unsigned int position = 0;
+    char temp_path[strlen(db->path) + 5];
+    db_entry entry;
+    int fd = -1;
+
+    for(slot = 0; slot < old->capacity; slot++){
+	position = atomic_load_explicit(&old->slots[slot].position,
+					memory_order_relaxed);
+	if(position == 0 ||
+	   position - 1 + (unsigned long long) old->slots[slot].size > old->room)
+	    continue;
+	live += old->slots[slot].size;
+	count++;
+    }
+    while(3*(count + 1) > capacity) capacity *= 2;
+    while(4*(live + size) > 3*room) room *= 2;
+    if(capacity > DB_MAX_SLOTS || room > DB_MAX_LETTERS) return 0;
+
+    sprintf(temp_path, "%s.tmp", db->path);
+    fd = open(temp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1) return 0;
+    // New file stays locked, so writers that open it once renamed wait
+    if(flock(fd, LOCK_EX) != 0 || !db_init_file(fd, capacity, room) ||
+       (map = db_map_file(fd, 0)) == NULL){
+	close(fd);
+	unlink(temp_path);
+	return 0;
+    }
+    for(slot = 0; slot < old->capacity; slot++){
+	position = atomic_load_explicit(&old->slots[slot].position,
+					memory_order_relaxed);
+	if(position == 0 ||
+	   position - 1 + (unsigned long long) old->slots[slot].size > old->room)
+	    continue;
+	entry.word = old->letters + position - 1;
+	entry.size = old->slots[slot].size;
+	entry.NI = old->slots[slot].NI;
+	entry.hash = hash_word(entry.word, entry.size);
+	db_store(map, db_find(map, entry.word, entry.size, entry.hash),
+		 &entry);
+    }
+    if(rename(temp_path, db->path) != 0){
+	munmap(map->base, map->length);
+	free(map);
+	close(fd);
+	unlink(temp_path);
+	return 0;
+    }
+    db_replace_map(db, map, fd);
+    return 1;
+}
+
+//// db_lock function
+// Given a database, takes its mutex and an exclusive lock on its file. If
+// another handle has replaced the file since, moves to the file now at its
+// path first. Returns 0 if file could not be locked, else 1.
+short db_lock(ni_db * db)
+{
+    struct stat path_info, file_info;
+    db_map * map = NULL;
+    int fd = -1;
+
+    pthread_mutex_lock(&db->lock);
+    while(flock(db->fd, LOCK_EX) == 0){
+	if(stat(db->path, &path_info) != 0 || fstat(db->fd, &file_info) != 0)
+	    break;
+	if(path_info.st_dev == file_info.st_dev &&
+	   path_info.st_ino == file_info.st_ino)
+	    return 1;
+	fd = open(db->path, O_RDWR);
+	if(fd == -1) break;
+	map = db_map_file(fd, 0);
+	if(map == NULL){
+	    close(fd);
+	    break;
+	}
+	db_replace_map(db, map, fd);
+    }
+    flock(db->fd, LOCK_UN);
+    pthread_mutex_unlock(&db->lock);
+    return 0;
+}
+
+//// db_unlock function
+// Given a database locked by db_lock, unlocks it.
+void db_unlock(ni_db * db)
+{
+    flock(db->fd, LOCK_UN);
+    pthread_mutex_unlock(&db->lock);
+}
+
+//// db_replace_map function
+// Given a locked database, a map of the file now at its path and that
+// file, makes them those of database and unlocks the old file. The old map
+// is kept, as readers may still be using it.
+void db_replace_map(ni_db * db, db_map * map, int fd)
+{
+    map->next = atomic_load(&db->map);
+    atomic_store_explicit(&db->map, map, memory_order_release);
+    flock(db->fd, LOCK_UN);
+    close(db->fd);
+    db->fd = fd;
+}
+
+
+//// count_level function
+// Given statistics (may be NULL) and the words of a level of get_NI_bounded
+// with their sizes and count, records the size of level and its bytes.
+void count_level(ni_stats * stats, unsigned short ** words, int * sizes,
+		 int count)
+{
+    size_t bytes = 0;
+    int i = 0;
+
+    if(stats == NULL) return;
+    if(stats->levels < STATS_LEVELS) stats->frontier[stats->levels] = count;
+    stats->levels++;
+    bytes = (sizeof(unsigned short *) + sizeof(int))*count;
+    for(i = 0; i < count; i++)
+	bytes += sizeof(unsigned short)*sizes[i];
+    if(bytes > stats->peak_bytes) stats->peak_bytes = bytes;
+}
+
+//// add_stats function
+// Adds the counts of stats to those of total, keeping the larger peak and
+// the frontier sizes of total.
+void add_stats(ni_stats * total, ni_stats * stats)
+{
+    total->steps += stats->steps;
+    total->children += stats->children;
+    total->duplicates += stats->duplicates;
+    total->subwords += stats->subwords;
+    total->seconds += stats->seconds;
+    if(stats->peak_bytes > total->peak_bytes)
+	total->peak_bytes = stats->peak_bytes;
+}
+
+//// clock_seconds function
+// Returns seconds of a monotonic clock, for timing words and phases.
+double clock_seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec/1e9;
+}
+
+//// index_word function
+// Given a word, its size and a letter index with room for size, sets the
+// partners of index (-1 for a letter that occurs once) and clears its
+// bitset, if it has one. Returns 0 if a letter occurs more than twice or
+// word is longer than MAX_DOW_SIZE, else 1. Letters are found with a hash
+// table so time is linear.
+short index_word(unsigned short * word, int size, letter_index * index)
+{
+    unsigned int capacity = 2, mask = 0, slot = 0;
+    int * partners = index->partners;
+    int i = 0;
+
+    if(size > MAX_DOW_SIZE) return 0;
+    if(index->in_seqs != NULL)
+	memset(index->in_seqs, 0, sizeof(unsigned int)*INDEX_MASKS(size));
+    while(capacity < 2*(unsigned int) size) capacity <<= 1;
+    mask = capacity - 1;
+    {
+	int first[capacity];	// Position of first occurrence, -1 if empty
+	for(slot = 0; slot < capacity; slot++) first[slot] = -1;
+	for(i = 0; i < size; i++){
+	    slot = (word[i]*2654435761u) & mask;
+	    while(first[slot] != -1 && word[first[slot]] != word[i])
+		slot = (slot + 1) & mask;
+	    if(first[slot] == -1){
+		first[slot] = i;
+		partners[i] = -1;
+	    }
+	    else if(partners[first[slot]] == -1){
+		partners[first[slot]] = i;
+		partners[i] = first[slot];
+	    }
+	    else return 0;	// Third occurrence
+	}
+    }
+    return 1;
+}
+
+//// index_seqs function
+// Given a letter index of word, word, its size and the maximal subwords of
+// word found by get_repeat_return_words with their count, sets the bits of
+// index for both occurrences of each letter in a subword. A subword runs
+// from its start while letters increase, up to the end of word.
+void index_seqs(letter_index * index, unsigned short * word, int size,
+		unsigned short ** seqs, int seq_count)
+{
+    int i = 0, j = 0;
+
+    for(i = 0; i < seq_count; i++){
+	j = seqs[i] - word;
+	do{
+	    index->in_seqs[j/32] |= 1u << j%32;
+	    if(index->partners[j] != -1)
+		index->in_seqs[index->partners[j]/32] |=
+		    1u << index->partners[j]%32;
+	    j++;
+	} while(j < size && word[j] > word[j-1]);
+    }
+}
+
+//// is_double_occurrence function
+// Given a word w and its size, returns 1 if w is double occurrence, else 0.
+// A word of odd size passes if its last new letter is the only one that
+// occurs once, as its first size/2 letters all occur twice. The empty word
+// is double occurrence.
+short is_double_occurrence(unsigned short * word, int size)
+{
+    int i = 0, single = -1;
+
+    if(size > MAX_DOW_SIZE) return 0;
+    {
+	int partners[size + 1];
+	letter_index index = {partners, NULL};
+
+	if(!index_word(word, size, &index)) return 0;
+	for(i = 0; i < size; i++){
+	    if(partners[i] == -1){
+		if(single != -1 || size%2 == 0) return 0;
+		single = i;
+	    }
+	    else if(single != -1 && partners[i] > i) return 0;
+	}
+    }
+    return 1;
+}
+
+
+//// get_repeat_return_words function
+// Given a DOW w, its size and an array subwords with room for size/2 words,
+// finds the maximal subwords of w and stores in subwords pointers to where
+// each one begins in w. Returns the number of maximal subwords found.
+int get_repeat_return_words(unsigned short * w, int size,
+			    unsigned short ** subwords)
+{
+    unsigned int ones[DIFF_MASKS(size)], zeros[DIFF_MASKS(size)];
+    unsigned int starts[DIFF_MASKS(size)];
+    int i = 0, count = 0, len = 0, run = 0, diff = 0;
+    int state = 0, place = 0;	// Positions go past SHRT_MAX in long words
+	
+    // Algorithm uses diff = w[i+1] - w[i] for i in 0:size.
+    // Note that if diff == [1 1 ... 1 0 -1 ... -1 -1] word is return word
+    // and if diff == [1 1 ... 1 -n 1 ... 1 1] word is repeat word
+    get_diffs(w, size, ones, zeros);
+    for(i = 0; i < DIFF_MASKS(size); i++)
+	starts[i] = ones[i] | zeros[i];
+	
+    // Checks for return words
+    state = 0;
+    place = 0;
+    count = 0;
+    for(i = 0; i < size - 1; i++){
+	if(state == 0){	// Only a 0 or a 1 changes state 0
+	    i = next_diff(starts, i, size - 1);
+	    if(i == size - 1) break;
+	}
+	diff = w[i+1] - w[i];
+	switch(diff) {
+	case 0:    // Expecting -1
+	    if(state == 1 && i != size - 2) state = 2;
+	    else{	// Must be a loop
+		subwords[len++] = w + i;
+		state = 0;
+		count = 0;
+	    }
+	    break;
+	case 1:
+	    if(state == 0) place = i;  // Holds placement of first 1
+	    else if(state == 2){
+		place += count;
+		subwords[len++] = w + place;
+		place = i;
+		count = 0;
+	    }					
+	    state = 1;	// Expecting 0
+	    run = diff_run(ones, i + 1, size - 1);  // Takes run of 1s at once
+	    count += run + 1;
+	    i += run;
+	    break;
+	case -1:
+	    if(state == 2){
+		count--;
+		if(count == 0 || (i == size - 2)){	// Return word found
+		    if(i == size - 2)	place += count;
+		    subwords[len++] = w + place;
+		    state = 0;
+		    count = 0;
+		}
+	    }
+	    else{
+		state = 0;
+		count = 0;
+	    }
+	    break;
+	default:
+	    if(state == 2){	// Return word found
+		place += count;
+		subwords[len++] = w + place;
+	    }		
+	    state = 0;
+	    count = 0;
+	}
+    }
+	
+    // Checks for repeat words
+    state = 0;
+    place = 0;
+    count = 0;
+    for(i = 0; i < size - 1; i++){
+	if(state == 0){	// Only a 1 changes state 0
+	    i = next_diff(ones, i, size - 1);
+	    if(i == size - 1) break;
+	}
+	diff = w[i+1] - w[i];
+	switch(diff) {
+	case 1:
+	    if(state == 0 || state == 1){
+		if(state == 0) place = i;
+		state = 1;
+		run = diff_run(ones, i + 1, size - 1);
+		count += run + 1;
+		i += run;
+	    }
+	    else if(state == 2){
+		count--;
+		if(count == 0){	// Repeat word found
+		    subwords[len++] = w + place;
+		    state = 0;
+		    count = 0;					
+		}
+	    }
+	    break;
+	default:
+	    if(state == 1){
+		if(diff < 0 && (-1)*count <= diff){
+		    place += (count + diff);
+		    count = (-1)*diff;	// Number of 1s expected
+		    state = 2;
+		}
+		else{
+		    state = 0;
+		    count = 0;
+		}
+	    }
+	    else{
+		state = 0;
+		count = 0;
+	    }
+	}
+    }
+    return len;
+}
+
+//// get_diffs function
+// Given a word w and its size, sets bit i of ones (zeros) for i in 0:size-1
+// if w[i+1] - w[i] is 1 (0). Masks need DIFF_MASKS(size) elements. The masks
+// are computed by the fastest kernel the processor has, the last few bits
+// of them by the loop below.
+void get_diffs(unsigned short * w, int size, unsigned int * ones,
+	       unsigned int * zeros)
+{
+    diff_function kernel = atomic_load_explicit(&diff_kernel,
+						memory_order_relaxed);
+    int i = 0, diff = 0;
+
+    if(kernel == NULL) kernel = select_diff_kernel();
+    i = kernel(w, size, 0, ones, zeros);
+    for(; i < size - 1; i++){
+	if(i%32 == 0) ones[i/32] = zeros[i/32] = 0;
+	diff = w[i+1] - w[i];
+	if(diff == 1) ones[i/32] |= 1u << i%32;
+	else if(diff == 0) zeros[i/32] |= 1u << i%32;
+    }
+}
+
+//// select_diff_kernel function
+// Picks the kernel get_diffs uses, stores it in diff_kernel and returns it.
+// Every thread picks the same kernel, so racing calls are harmless.
+diff_function select_diff_kernel(void)
+{
+    diff_function kernel = get_diffs_none;
+
+#if SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) kernel = get_diffs_avx2;
+    else kernel = get_diffs_sse2;
+#endif
+    atomic_store_explicit(&diff_kernel, kernel, memory_order_relaxed);
+    return kernel;
+}
+
+//// get_diffs_none function
+// Kernel of processors without vector instructions: computes nothing and
+// returns from, leaving every mask bit to get_diffs.
+int get_diffs_none(unsigned short * w, int size, int from,
+		   unsigned int * ones, unsigned int * zeros)
+{
+    return from;
+}
+
+#if SIMD_X86
+//// DIFFS_16 macro
+// Computes mask bits i to i + 15 of get_diffs with 128 bit vectors. Used by
+// both kernels, so the AVX2 kernel never runs legacy SSE instructions.
+// Differences are taken mod 2^16, so 0 after 65535 would pass for a
+// difference of 1; such pairs are cleared from ones.
+#define DIFFS_16(w, i, ones, zeros)					\
+{									\
+    const __m128i one = _mm_set1_epi16(1), zero = _mm_setzero_si128();	\
+    const __m128i top = _mm_set1_epi16(-1);				\
+    __m128i low_w, high_w, low, high;					\
+									\
+    low_w = _mm_loadu_si128((__m128i *) (w + i));			\
+    high_w = _mm_loadu_si128((__m128i *) (w + i + 8));			\
+    low = _mm_sub_epi16(_mm_loadu_si128((__m128i *) (w + i + 1)), low_w); \
+    high = _mm_sub_epi16(_mm_loadu_si128((__m128i *) (w + i + 9)),	\
+			 high_w);					\
+    if(i%32 == 0) ones[i/32] = zeros[i/32] = 0;			\
+    /* Packing the 16 bit lanes to bytes keeps one mask bit per lane */ \
+    ones[i/32] |= (unsigned int) _mm_movemask_epi8(			\
+	_mm_packs_epi16(						\
+	    _mm_andnot_si128(_mm_cmpeq_epi16(low_w, top),		\
+			     _mm_cmpeq_epi16(low, one)),		\
+	    _mm_andnot_si128(_mm_cmpeq_epi16(high_w, top),		\
+			     _mm_cmpeq_epi16(high, one)))) << i%32;	\
+    zeros[i/32] |= (unsigned int) _mm_movemask_epi8(			\
+	_mm_packs_epi16(_mm_cmpeq_epi16(low, zero),			\
+			_mm_cmpeq_epi16(high, zero))) << i%32;		\
+}
+
+//// get_diffs_sse2 function
+// Given a word w, its size and a multiple from of 16, computes mask bits of
+// get_diffs from difference from, 16 at a time, while all letters involved
+// are in w. Returns the first difference not done.
+int get_diffs_sse2(unsigned short * w, int size, int from,
+		   unsigned int * ones, unsigned int * zeros)
+{
+    int i;
+
+    for(i = from; i + 16 < size; i += 16)
+	DIFFS_16(w, i, ones, zeros);
+    return i;
+}
+
+//// get_diffs_avx2 function
+// Same as get_diffs_sse2, 32 differences at a time; from is a multiple of 32.
+__attribute__((target("avx2")))
+int get_diffs_avx2(unsigned short * w, int size, int from,
+		   unsigned int * ones, unsigned int * zeros)
+{
+    const __m256i one = _mm256_set1_epi16(1), zero = _mm256_setzero_si256();
+    const __m256i top = _mm256_set1_epi16(-1);
+    __m256i low_w, high_w, low, high;
+    int i;
+
+    for(i = from; i + 32 < size; i += 32){
+	low_w = _mm256_loadu_si256((__m256i *) (w + i));
+	high_w = _mm256_loadu_si256((__m256i *) (w + i + 16));
+	low = _mm256_sub_epi16(_mm256_loadu_si256((__m256i *) (w + i + 1)),
+			       low_w);
+	high = _mm256_sub_epi16(_mm256_loadu_si256((__m256i *) (w + i + 17)),
+				high_w);
+	// Packing works within 128 bit halves; the permute restores order
+	ones[i/32] = _mm256_movemask_epi8(_mm256_permute4x64_epi64(
+	    _mm256_packs_epi16(
+		_mm256_andnot_si256(_mm256_cmpeq_epi16(low_w, top),
+				    _mm256_cmpeq_epi16(low, one)),
+		_mm256_andnot_si256(_mm256_cmpeq_epi16(high_w, top),
+				    _mm256_cmpeq_epi16(high, one))), 0xd8));
+	zeros[i/32] = _mm256_movemask_epi8(_mm256_permute4x64_epi64(
+	    _mm256_packs_epi16(_mm256_cmpeq_epi16(low, zero),
+			       _mm256_cmpeq_epi16(high, zero)), 0xd8));
+    }
+    if(i + 16 < size){
+	DIFFS_16(w, i, ones, zeros);
+	i += 16;
+    }
+    return i;
+}
+#endif
+
+//// next_diff function
+// Given a mask of differences, an index from and a limit, returns the first
+// index i >= from whose bit is set, or limit if there is none below limit.
+// Bits at limit and above must be clear.
+int next_diff(unsigned int * mask, int from, int limit)
+{
+    unsigned int bits;
+    int k;
+
+    if(from >= limit) return limit;
+    bits = mask[from/32] >> from%32;
+    if(bits) return from + __builtin_ctz(bits);
+    for(k = from/32 + 1; 32*k < limit; k++){
+	if(mask[k]) return 32*k + __builtin_ctz(mask[k]);
+    }
+    return limit;
+}
+
+//// diff_run function
+// Given a mask of differences, an index from and a limit, returns the number
+// of consecutive set bits starting at from. Bits at limit and above must be
+// clear.
+int diff_run(unsigned int * mask, int from, int limit)
+{
+    unsigned int bits;
+    int run = 0;
+
+    while(from < limit){
+	bits = ~mask[from/32] >> from%32;
+	if(bits) return run + __builtin_ctz(bits);
+	run += 32 - from%32;
+	from += 32 - from%32;
+    }
+    return run;
+}
+
+
+//// remove_sequences function
+// Given assembly word w, its letter index with the maximal subwords of w set
+// (see index_seqs) and an array new_word with room for size letters, stores
+// w - subwords, i.e., word obtained from w after removing subwords, in
+// new_word and returns new_word. Updates new_size with its size.
+unsigned short * remove_seqs(unsigned short * word, int size,
+			     letter_index * index, unsigned short * new_word,
+			     int * new_size)
+{
+    int i = 0;
+	
+    *new_size = 0;
+    for(i = 0; i < size; i++){
+	if(!IN_SEQ(index, i)){
+	    new_word[*new_size] = word[i];
+	    *new_size += 1;
+	}
+    }
+    return new_word;
+}
+
+
+//// remove_ltr function
+// Given a DOW w, its size, a letter and an array new_word with room for
+// size - 2 letters, stores word obtained from w after removing letter in
+// new_word and returns new_word.
+unsigned short * remove_ltr(unsigned short * word, int size, unsigned short letter,
+			    unsigned short * new_word)
+{
+    int i = 0, new_size = 0;
+	
+    i=0;
+    while (word[i] != letter){
+	new_word[new_size++] = word[i++];
+    }
+    i = size-1;
+    while (word[i] != letter){
+	new_word[i-2] = word[i];
+	i--;
+    }
+    i--;
+    while (word[i] != letter){
+	new_word[new_size++] = word[i--];
+    }
+    return new_word;
+}
+
+////relabel function
+// Given a DOW w and its size, relabels w in place and returns it. Letters are
+// renamed in order of first occurrence through a table indexed by letter.
+unsigned short * relabel(unsigned short * word, int size)
+{
+    unsigned short max_ltr = 0, new_ltr = 0;
+    int i;
+	
+    for(i = 0; i < size; i++){
+	if(word[i] > max_ltr) max_ltr = word[i];
+    }
+    {
+	unsigned short labels[max_ltr + 1];	// 0 if letter not seen yet
+	memset(labels, 0, sizeof(unsigned short)*(max_ltr + 1));
+	for(i = 0; i < size; i++){
+	    if(labels[word[i]] == 0) labels[word[i]] = ++new_ltr;
+	    word[i] = labels[word[i]];
+	}
+    }
+    return word;
+}
+
+
+//// get_reverse function
+// Given a word, its size and room for size letters, stores the relabeled
+// reverse of word in reverse.
+void get_reverse(unsigned short * word, int size, unsigned short * reverse)
+{
+    int i = 0;
+
+    for(i = 0; i < size; i++)
+	reverse[i] = word[(size - 1) - i];
+    relabel(reverse, size);
+}
+
+
+//// get_isomorphisms function
+// Given a word, its size and room for 2*size*size letters, stores in
+// isomorphisms the distinct relabeled rotations of word and then those of
+// its reverse not found among them, size letters each, and returns their
+// number. Rotations of a word repeat once the first one is found again.
+int get_isomorphisms(unsigned short * word, int size,
+		     unsigned short * isomorphisms)
+{
+    unsigned short reverse[size + 1];
+    unsigned short * source = word, * temp_word = NULL;
+    int i = 0, offset = 0, count = 0, pass = 0;
+    short isDup = 0;
+
+    get_reverse(word, size, reverse);
+    // Rotations of word, then same as above, only with reverse
+    for(pass = 0; pass < 2; pass++, source = reverse){
+	offset = 0;
+	isDup = 0;
+	while(offset < size && !isDup){
+	    temp_word = isomorphisms + (size_t) count*size;
+	    for(i = 0; i + offset < size; i++)
+		temp_word[i] = source[i + offset];
+
+	    for(i = 0; i < offset; i++)
+		temp_word[(size - offset) + i] = source[i];
+
+	    relabel(temp_word, size);
+
+	    isDup = 0;
+	    for(i = 0; i < count && !isDup; i++)
+		isDup = (memcmp(isomorphisms + (size_t) i*size, temp_word,
+				sizeof(short)*size) == 0);
+	    if(!isDup){
+		count++;
+		offset++;
+	    }
+	}
+    }
+    return count;
+}
@@ -0,0 +1,489 @@
+// NestEngine.h
+// ----------------------------------------------------------------------------
+// Purpose: Types and functions of the reduction engine behind nestindex.h,
+//          shared by NestEngine.c, the NestIndex command line program and
+//          the NestBench benchmarks. Not installed with the library.
+// ----------------------------------------------------------------------------
+#ifndef NEST_ENGINE_H
+#define NEST_ENGINE_H
+
+// Standard C libs
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>	//contains INT_MAX
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "nestindex.h"
+
+
+// Arena types
+// A word arena hands out room for words from large blocks, so the words of a
+// level of get_NI lie contiguously in memory and are all freed at once when
+// the level is done with. Blocks are kept on reset for the next level.
+typedef struct arena_block {
+    struct arena_block * next;
+    size_t capacity;		// Number of letters block holds
+    size_t used;		// Number of letters handed out
+    unsigned short letters[];
+} arena_block;
+
+typedef struct word_arena {
+    arena_block * first;
+    arena_block * current;	// Blocks after current are unused
+} word_arena;
+
+#define ARENA_MIN_LETTERS 32768
+#define ARENA_MAX_LETTERS 16777216
+
+// Database types
+// An NI database is a file holding an open-addressing table (linear probing)
+// of words and their nesting indices, keyed as memo tables are, kept across
+// runs and shared by processes. It is mapped with mmap and read without
+// locks; a writer holds the mutex of its handle and an exclusive flock on the
+// file to add words. A slot is published by storing its position last, so
+// readers see either an empty slot or a whole entry. Entries are never
+// removed. Once the table is half full or its letters are used up, the writer
+// compacts the entries into a new file with twice the room and renames it
+// over the old one; handles mapping the old file go on reading it and move to
+// the new one the next time they lock it. A file is a db_header, padded to
+// DB_HEADER_BYTES, then capacity slots and the letters of the words. Ints are
+// in native byte order.
+#define DB_MAGIC "NIDB001\n"
+#define DB_HEADER_BYTES 4096
+#define DB_MIN_SLOTS 65536
+#define DB_MIN_LETTERS 1048576
+#define DB_MAX_LETTERS 0xfffffffeULL	// Positions + 1 fit in 32 bits
+#define DB_MAX_SLOTS 0x80000000ULL
+#define DB_BATCH_WORDS 256
+
+typedef struct db_header {
+    char magic[8];
+    unsigned long long capacity;	// Number of slots, power of 2
+    unsigned long long room;		// Number of letters file holds
+    unsigned long long used;		// Letters handed out
+    _Atomic unsigned long long count;	// Number of entries
+} db_header;
+
+typedef struct db_slot {
+    unsigned int hash;
+    unsigned int size;
+    int NI;
+    atomic_uint position;	// First letter of word + 1, 0 if slot is empty
+} db_slot;
+
+// A mapping of a database file. Maps replaced after a compaction are kept
+// until the handle is closed, as readers may still be using them.
+typedef struct db_map {
+    struct db_map * next;	// Map replaced before this one
+    char * base;
+    size_t length;
+    db_header * header;
+    db_slot * slots;
+    unsigned short * letters;
+    unsigned long long capacity, room;	// As checked when mapped
+} db_map;
+
+typedef struct ni_db {
+    char * path;
+    int fd;			// File of map
+    short read_only;
+    _Atomic(db_map *) map;
+    pthread_mutex_t lock;	// Held by the thread adding words
+} ni_db;
+
+// A word waiting to be added to a database
+typedef struct db_entry {
+    unsigned short * word;
+    int size;
+    int NI;
+    unsigned int hash;
+} db_entry;
+
+// Memo table types
+// A memo table maps words to their nesting index: the relabeled children of
+// reductions, and words reduced by get_NI as they were given. Its memory is
+// capped by a byte budget; once the budget is reached entries are evicted
+// using the CLOCK (second chance) policy. A table may have a shared memo and
+// an NI database behind it: words it misses are looked up there, in that
+// order, and words stored in it are added to the shared memo at once and to
+// the database in batches of DB_BATCH_WORDS.
+typedef struct memo_entry {
+    unsigned short * word;	// NULL when slot is empty
+    int size;
+    int NI;
+    unsigned int hash;
+    unsigned char ref;		// Set on hit, cleared as clock hand passes
+} memo_entry;
+
+typedef struct memo_table {
+    memo_entry * slots;
+    unsigned int capacity;	// Number of slots, power of 2
+    unsigned int count;		// Number of occupied slots
+    unsigned int hand;		// Clock hand for eviction
+    size_t bytes;		// Memory used by slots and stored words
+    size_t budget;		// Memory table may use
+    unsigned long hits, misses, evictions;
+    struct shared_memo * shared;	// Shared memo behind table, NULL if none
+    ni_db * db;			// Database behind table, NULL if none
+    db_entry * pending;		// Words for db not yet added to it
+    int pending_count;
+    word_arena pending_arena;	// Letters of pending words
+    unsigned long db_hits, db_misses;
+    word_arena * spare_arenas;	// Arenas kept from the last reduction
+    int spare_count;		// 0 if none are kept
+    int spare_room;		// Arenas spare_arenas has room for
+} memo_table;
+
+// Shared memo types
+// With several jobs, the memo tables of a context have a shared memo behind
+// them, so a word reduced by one thread is known to all. It is split into
+// SHARED_MEMO_STRIPES memo tables, picked by the high bits of the hash of a
+// word, each behind a lock of its own, so threads only wait for each other
+// when they touch the same stripe. Words are added only if absent. Each
+// stripe gets an equal share of the budget and evicts with CLOCK on its own,
+// which approximates CLOCK over the whole memo. Stripes are cache line
+// aligned so their locks do not share lines.
+#define SHARED_MEMO_STRIPES 64
+#define SHARED_MEMO_SHIFT 26	// Leaves the top 6 bits of 32-bit hashes
+// With several jobs, the tables of threads get 1/MEMO_PRIVATE_SHARE of the
+// memo budget and the shared memo gets the rest, unless the budget is below
+// SHARED_MEMO_MIN_BYTES (about 6 MB with 24-byte memo entries), too little
+// for stripes to hold more than a few slots, in which case there is no
+// shared memo.
+#define MEMO_PRIVATE_SHARE 4
+#define SHARED_MEMO_MIN_BYTES \
+    (SHARED_MEMO_STRIPES*4*MEMO_MIN_SLOTS*sizeof(memo_entry))
+
+typedef struct memo_stripe {
+    pthread_mutex_t lock;
+    memo_table * table;		// NULL if not alloc'd
+} __attribute__((aligned(64))) memo_stripe;
+
+typedef struct shared_memo {
+    memo_stripe stripes[SHARED_MEMO_STRIPES];
+} shared_memo;
+
+// Letters of blocks a memo table keeps in its spare arenas; blocks of
+// larger reductions are freed
+#ifndef ARENA_SPARE_LETTERS
+#define ARENA_SPARE_LETTERS 16777216
+#endif
+
+// Default budget of the table of depths refuted by search_reduction
+#ifndef SEARCH_TABLE_MB
+#define SEARCH_TABLE_MB 64
+#endif
+
+// Query type
+// How nesting indices of a context are computed: the bound on NIs (see
+// get_NI_bounded), the engine (see compute_NI), the memory budget of the
+// table of refuted depths used by ENGINE_DFS, the cancel function of
+// options, checked once per level by ENGINE_BFS and per word searched by
+// ENGINE_DFS, and the limits of options on each word (see nestindex.h).
+// compute_NI sets the deadline of the word it reduces from its time limit.
+typedef struct ni_query {
+    int bound;
+    int engine;
+    size_t table_budget;
+    int (*cancel)(void *);	// NULL if reductions are never cancelled
+    void * cancel_arg;
+    double time_limit;		// 0 if words have no limits
+    size_t frontier_limit;
+    size_t memory_limit;
+    double deadline;		// Clock at which word is cut off, 0 if none
+} ni_query;
+
+#define QUERY_CANCELLED(query) \
+    ((query)->cancel != NULL && (query)->cancel((query)->cancel_arg))
+#define QUERY_OVER_TIME(query) \
+    ((query)->deadline > 0 && clock_seconds() > (query)->deadline)
+
+
+// Statistics
+// Each word reduced with statistics gets an ni_stats (see nestindex.h),
+// filled in by step, expand_level and get_NI_bounded. Functions take a NULL
+// ni_stats when statistics are off, so counting costs a branch that is never
+// taken; build with -DNO_STATS to compile it out.
+#ifndef NO_STATS
+#define STATS_ADD(stats, field, amount)					\
+    if((stats) != NULL) (stats)->field += (amount)
+#else
+#define STATS_ADD(stats, field, amount) ((void) (amount))
+#endif
+
+#define MEMO_DEFAULT_MB 64
+#define MEMO_MIN_SLOTS 1024
+#ifndef MEMO_SMALL_SIZE
+#define MEMO_SMALL_SIZE 12
+#endif
+
+
+// Batch types
+// Threads working on a batch of words (see reduce_batch) take the next word
+// not yet taken, so a slow word holds up only its own thread, and store NIs
+// by index so results keep the order of the batch. A batch of classes (see
+// reduce_classes) stores the nesting indices of the class of each word
+// instead.
+typedef struct batch_job {
+    unsigned short ** words;
+    int * sizes;
+    int * NIs;			// NULL for a batch of classes
+    int ** class_NIs;		// NULL for a batch of words
+    int * class_sizes;
+    int count;
+    const ni_query * query;
+    ni_stats * stats;		// One per word, NULL if statistics are off
+    atomic_int next;		// Index of next word to be taken
+} batch_job;
+
+typedef struct batch_worker_arg {
+    batch_job * job;
+    memo_table * memo;		// Each thread has a memo table of its own
+} batch_worker_arg;
+
+
+// Level types
+// With several threads, a level of get_NI_parallel is expanded in two
+// phases. First each thread steps words taken from the front of its own range
+// of the level, stealing half of another thread's range from the back once
+// its own is empty, and files each child in a bucket by hash. Then each
+// partition of the hash space is deduplicated by one thread.
+typedef struct level_child {
+    unsigned short * word;
+    int size;
+    unsigned int hash;
+} level_child;
+
+typedef struct child_list {
+    level_child * children;
+    int count;
+    int capacity;
+} child_list;
+
+typedef struct work_range {
+    pthread_mutex_t lock;
+    int lo, hi;			// Words [lo, hi) of level not yet taken
+} work_range;
+
+typedef struct level_job {
+    unsigned short ** words;	// Words of current level
+    int * sizes;
+    int count;
+    int jobs;
+    work_range * ranges;	// One per thread
+    word_arena * arenas;	// One per thread, holds the next level
+    child_list * buckets;	// jobs x jobs, [thread*jobs + partition]
+    child_list * uniques;	// One per partition, deduplicated children
+    atomic_int next_partition;	// Next partition to be deduplicated
+    atomic_int found_empty;	// Set once a word steps to the empty word
+    atomic_int empty_index;	// Index of first such word, -1 if none
+    atomic_int out_of_memory;
+    ni_stats * stats;		// NULL if statistics are off
+} level_job;
+
+typedef struct level_worker_arg {
+    level_job * job;
+    int id;
+    ni_stats stats;		// Counts of thread, added to those of job
+} level_worker_arg;
+
+#define PARALLEL_MIN_WORDS 64
+
+// Words of the last level of a word cut off by a limit that record_cut_off
+// reduces greedily for an upper bound on its nesting index
+#define GREEDY_WORDS 256
+
+
+// Class masks
+// get_NI_class reduces the words of a class together; each word of a level
+// carries a mask of the words of class it was reached from, with bit r % 64
+// of element r/64 set for word r of class.
+#define CLASS_MASK_WORDS(count) (((count) + 63)/64)
+#define CLASS_BIT(mask, r) ((mask)[(r)/64] >> (r)%64 & 1)
+
+
+// Packed words
+// step has kernels for words of up to PACKED_LETTERS letters, each at most
+// 16, that hold letter - 1 in 4 bits (nibble i is letter i) of a single
+// register: unsigned long long for up to 16 letters and, where the compiler
+// has it, unsigned __int128 for up to 32. Build with -DNO_PACKED_WORDS to
+// use the generic step only.
+#define PACKED_UNFIT -2		// Word does not fit packed kernel
+#if defined(__SIZEOF_INT128__) && !defined(NO_PACKED_WORDS)
+#define PACKED_LETTERS 32
+#elif !defined(NO_PACKED_WORDS)
+#define PACKED_LETTERS 16
+#else
+#define PACKED_LETTERS 0
+#endif
+
+
+// Difference kernels
+// get_repeat_return_words works from bitmasks (bit i % 32 of element i/32)
+// of the differences w[i+1] - w[i] of a word equal to 1 and to 0, and takes
+// other differences from the word where the masks lead it. On x86-64 the
+// masks are computed 16 letters at a time with SSE2 or, if the processor has
+// it, 32 at a time with AVX2; the kernel is picked once at run time. Build
+// with -DNO_SIMD to use the scalar kernel only.
+#if defined(__x86_64__) && !defined(NO_SIMD)
+#include <immintrin.h>
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+#define DIFF_MASKS(size) (((size) + 31)/32)	// Mask elements for a word
+
+typedef int (* diff_function)(unsigned short *, int, int, unsigned int *,
+			      unsigned int *);
+
+
+// Letter index
+// A letter index of a word holds, for each position, the position of the
+// other occurrence of its letter and whether that letter is in a maximal
+// subword, so step answers both in O(1). It is built in one pass with
+// index_word; the caller provides room for size ints and INDEX_MASKS(size)
+// unsigned ints.
+#define INDEX_MASKS(size) (((size) + 31)/32)
+#define IN_SEQ(index, i) ((index)->in_seqs[(i)/32] >> (i)%32 & 1)
+// Relabeled letters run from 1 to USHRT_MAX, so the engine takes DOWs of up
+// to this many letters. Longer words are turned away as not DOWs before any
+// stack array is sized by them.
+#define MAX_DOW_SIZE (2*USHRT_MAX)
+
+typedef struct letter_index {
+    int * partners;		// Other occurrence of letter at i, -1 if none
+    unsigned int * in_seqs;	// Bit i set if letter at i in maximal subword
+} letter_index;
+
+
+// Function templates
+int step(unsigned short *, int, unsigned short **, int *, word_arena *,
+	 ni_stats *);
+int step_packed16(unsigned short *, int, unsigned short **, int *,
+		  word_arena *, ni_stats *);
+#if PACKED_LETTERS == 32
+int step_packed32(unsigned short *, int, unsigned short **, int *,
+		  word_arena *, ni_stats *);
+#endif
+unsigned long long reverse_nibbles64(unsigned long long);
+#if PACKED_LETTERS == 32
+unsigned __int128 reverse_nibbles128(unsigned __int128);
+int ctz128(unsigned __int128);
+#endif
+int get_NI(unsigned short *, int, memo_table *);
+int get_NI_parallel(unsigned short *, int, memo_table *, int);
+int get_NI_bounded(unsigned short *, int, memo_table *, int, const ni_query *,
+		   ni_stats *);
+short steps_to_empty(unsigned short *, int);
+int compute_NI(unsigned short *, int, memo_table *, int, const ni_query *,
+	       ni_stats *);
+int get_NI_search(unsigned short *, int, memo_table *, const ni_query *,
+		  ni_stats *);
+int compute_class(unsigned short *, int, memo_table *, const ni_query *,
+		  int *, ni_stats *);
+short get_NI_class(unsigned short *, int, int, memo_table *,
+		   const ni_query *, int *, ni_stats *);
+int settle_class(int *, int, unsigned long long *, unsigned long long *, int,
+		 memo_table *, unsigned short *, int);
+short merge_class_words(unsigned short **, int *, unsigned long long *, int,
+			unsigned long long *, int *);
+short search_reduction(unsigned short *, int, int, int, memo_table *,
+		       memo_table *, const ni_query *);
+short search_child(unsigned short *, int, int, int, memo_table *,
+		   memo_table *, const ni_query *);
+int get_reduction(unsigned short *, int, memo_table *, const ni_query *,
+		  unsigned short *, int *, int *);
+int level_limit(const ni_query *, unsigned short **, int *, int, int);
+void record_cut_off(ni_stats *, int, int, int, unsigned short **, int *, int,
+		    int);
+int greedy_steps(unsigned short *, int);
+int expand_level(unsigned short **, int *, int, unsigned short **, int *,
+		 word_arena *, int, int *, ni_stats *);
+void count_level(ni_stats *, unsigned short **, int *, int);
+void add_stats(ni_stats *, ni_stats *);
+double clock_seconds(void);
+short take_work(level_job *, int, int *);
+short add_child(child_list *, unsigned short *, int, unsigned int);
+void * level_step_worker(void *);
+void * level_dedup_worker(void *);
+void run_threads(void * (*)(void *), void *, size_t, int);
+short index_word(unsigned short *, int, letter_index *);
+void index_seqs(letter_index *, unsigned short *, int, unsigned short **,
+		int);
+short is_double_occurrence(unsigned short *, int);
+int get_repeat_return_words(unsigned short *, int, unsigned short **);
+void get_diffs(unsigned short *, int, unsigned int *, unsigned int *);
+diff_function select_diff_kernel(void);
+int get_diffs_none(unsigned short *, int, int, unsigned int *,
+		   unsigned int *);
+#if SIMD_X86
+int get_diffs_sse2(unsigned short *, int, int, unsigned int *,
+		   unsigned int *);
+int get_diffs_avx2(unsigned short *, int, int, unsigned int *,
+		   unsigned int *);
+#endif
+int next_diff(unsigned int *, int, int);
+int diff_run(unsigned int *, int, int);
+unsigned short * remove_seqs(unsigned short *, int, letter_index *,
+			     unsigned short *, int *);
+unsigned short * remove_ltr(unsigned short *, int, unsigned short,
+			    unsigned short *);
+unsigned short * relabel(unsigned short *, int);
+short copy_words(unsigned short **, int *, unsigned short **, int *, int *);
+unsigned int hash_word(unsigned short *, int);
+void arena_init(word_arena *);
+unsigned short * arena_alloc(word_arena *, int);
+void arena_reset(word_arena *);
+void arena_release(word_arena *);
+size_t arena_letters(word_arena *);
+memo_table * memo_create(size_t);
+void memo_free(memo_table *);
+unsigned int memo_find(memo_table *, unsigned short *, int, unsigned int);
+int memo_lookup(memo_table *, unsigned short *, int);
+void memo_remove_slot(memo_table *, unsigned int);
+void memo_evict(memo_table *);
+short memo_grow(memo_table *);
+void memo_insert(memo_table *, unsigned short *, int, int);
+void memo_raise(memo_table *, unsigned short *, int, int);
+void memo_store(memo_table *, unsigned short *, int, unsigned int, int);
+void memo_queue(memo_table *, unsigned short *, int, unsigned int, int);
+void memo_take_arenas(memo_table *, word_arena *, int);
+void memo_keep_arenas(memo_table *, word_arena *, int);
+short memo_attach_db(memo_table *, ni_db *);
+void memo_flush(memo_table *);
+shared_memo * shared_memo_create(size_t);
+void shared_memo_free(shared_memo *);
+int shared_memo_lookup(shared_memo *, unsigned short *, int, unsigned int);
+void shared_memo_insert(shared_memo *, unsigned short *, int, unsigned int,
+			int);
+void shared_memo_counts(shared_memo *, ni_memo_counts *);
+int db_open(const char *, short, ni_db **);
+void db_close(ni_db *);
+db_map * db_map_file(int, short);
+short db_init_file(int, unsigned long long, unsigned long long);
+unsigned long long db_find(db_map *, unsigned short *, int, unsigned int);
+int db_lookup(ni_db *, unsigned short *, int, unsigned int);
+void db_insert(ni_db *, db_entry *, int);
+void db_store(db_map *, unsigned long long, db_entry *);
+short db_grow(ni_db *, int);
+short db_lock(ni_db *);
+void db_unlock(ni_db *);
+void db_replace_map(ni_db *, db_map *, int);
+int filter_known_words(memo_table *, unsigned short **, int *, int *, int,
+		       int);
+void reduce_batch(unsigned short **, int *, int *, int, memo_table **, int,
+		  const ni_query *, ni_stats *);
+void reduce_classes(unsigned short **, int *, int **, int *, int,
+		    memo_table **, int, const ni_query *, ni_stats *);
+void run_batch(batch_job *, memo_table **, int);
+void * batch_worker(void *);
+int get_canonical(unsigned short *, int, unsigned short *);
+int get_partners(unsigned short *, int, int *);
+int least_rotation(int *, int);
+void get_reverse(unsigned short *, int, unsigned short *);
+int get_isomorphisms(unsigned short *, int, unsigned short *);
+
+#endif
@@ -20,20 +20,111 @@
 // Command Line Arguments:
 // -h or --help:  Prints a usage message.
 // -t or --text:  For input of white-space delimited double occurrence words
-//                from a text file. Optionally include the name of an output
-//                text file.
+//                from a text file ("-" reads stdin). Words may be of any
+//                length. Optionally include the name of an output text file.
 // -c or --count: Uses input of white-space delimited double occurrence words
 //                from a text file, presents a summary of counts on the number
 //                of double occurrence words recognizing a certain nesting
 //                index.
 // -i or --isos:  For each word algorithm also considers all words that are
 //                cyclically equivalent. Program will print each word in the
-//                equivalence class as well as its Nesting Index
+//                equivalence class as well as its Nesting Index. The words
+//                of a class are reduced together, so words reached from
+//                several of them are reduced once. Given before -t (as in
+//                -i -t Infile.txt [Outfile.txt]), each word of input gets a
+//                line "word: min 1, max 2, NIs 1,2,2,1,1,2" with the least
+//                and greatest NI of its class and the NI of each word of
+//                class, in the order -i prints them.
+// --enumerate n: Presents a summary of counts on the number of DOWs with n
+//                letters recognizing a certain nesting index. Words are
+//                generated in relabeled form, with no input file. With
+//                --classes, words are reduced a class of cyclically
+//                equivalent words at a time; each NI gets its count of
+//                words and of classes whose least and greatest NI it is,
+//                with counts of class sizes.
+// --serve [socket]: Runs as a server answering words sent on stdin, or by
+//                the clients of the Unix socket at path socket, one word per
+//                line. Each word gets a line "word: NI latency" where
+//                latency is the time since the word arrived, such as 15us.
+//                Clients may send words without waiting for answers; all
+//                words that have arrived are reduced together, and memo
+//                tables stay warm between words. Stops at the end of stdin,
+//                or on SIGINT or SIGTERM.
+// --to-binary:   Converts a text file of words to a binary file of words
+//                (see binary corpus format below). Takes input and output
+//                file names; "-" is stdin or stdout.
+// --to-text:     Converts a binary file of words or of nesting indices to a
+//                text file. Takes input and output file names.
+// Options, which may be given with any of the above:
+// --memo MB:     Memory budget in megabytes for the table of known nesting
+//                indices shared by all words of a run (default 64, 0 turns
+//                the table off).
+// --memo-stats:  Prints hit and miss counts of the memo tables to stderr.
+// -j or --jobs N: Reduces the words of -t and -c on N threads. Output is the
+//                same as with one thread. Each thread gets a small memo
+//                table of its own, with an equal share of a quarter of the
+//                --memo budget; the rest goes to a memo table all threads
+//                share, so a word reduced by one thread is known to all. A
+//                single word is reduced with each level of its reduction
+//                split among N threads; with -i, classes are reduced on N
+//                threads.
+// --binary-out:  With -t, writes nesting indices as binary NI records.
+// --canonical:   With -t or -c, replaces each word of input by the canonical
+//                word of its class of cyclically equivalent words (see
+//                get_canonical) and skips words whose class was seen before,
+//                so each class is reduced once.
+// --max-ni k:    Nesting indices above k are not computed; such words are
+//                reported as "> k" (or NI_ABOVE_BOUND in binary NI records)
+//                as soon as every reduction of k steps is known to leave
+//                letters.
+// --engine E:    Search used to find nesting indices: bfs (default) builds
+//                every word of each level of reduction, dfs searches depth
+//                first with iterative deepening. Both give the same nesting
+//                indices. dfs needs memory linear in the size of word times
+//                its nesting index, besides its table of refuted depths. bfs
+//                falls back to dfs for words it runs out of memory on.
+// --db path:    Keeps nesting indices in the database file at path, created
+//                if missing, which later runs (and concurrent ones) reuse.
+//                Words missing from the memo table are looked up in it and
+//                words reduced are added to it. Several runs may share it.
+// --db-read-only: Looks nesting indices up in the --db database without
+//                adding to it.
+// --search-table MB: Memory budget in megabytes of the table of depths
+//                refuted by dfs, per word being reduced (default 64).
+// --time-limit s: Stops reducing a word after s seconds (may be fractional).
+// --frontier-limit n: Stops reducing a word once a level of its reduction
+//                holds more than n words.
+// --memory-limit MB: Stops reducing a word once a level of its reduction
+//                needs more than MB megabytes.
+//                A word stopped by a limit is reported as "between l and u
+//                (time limit)", where its nesting index is at least l, from
+//                the levels completed, and at most u, from a reduction found
+//                ("?" if none was). The run goes on with the next word, and
+//                with -t or -c the words stopped are listed on stderr at the
+//                end. The frontier and memory limits apply to the bfs
+//                engine; classes of -i are reduced without limits.
+// --stats:       With a single word, -t, -c or -i, prints a line of JSON to
+//                stderr for each word reduced: its step calls, children made,
+//                duplicates removed, maximal subwords found, words of each
+//                level, peak bytes of a level and wall time. Level and step
+//                counts come from the bfs engine. With -i a line is printed
+//                for each class, with the least NI of class. A last line
+//                gives totals and the wall time spent reading, reducing and
+//                writing; with -t, -c or -i -t these overlap, so they may
+//                add up to more than the total.
+// Input files of -t and -c may be text or binary, told apart by their first
+// bytes. They are read, reduced and written by stages that run at once, so
+// reading and writing keep pace with the reduction.
+// ----------------------------------------------------------------------------
+// The reduction engine is libnestindex (NestEngine.c, interface in
+// nestindex.h); this file reads input, calls the engine and writes output.
+// It uses nothing of the engine but nestindex.h, so it links against the
+// shared library as well as the static one.
 // ----------------------------------------------------------------------------
 // To compile, run:
 // >> make    (assuming Makefile is present)
 // or
-// >> gcc -lm -Wall NestIndex.c -o NestIndex
+// >> gcc -O2 -Wall -pthread NestIndex.c NestEngine.c -o NestIndex
 // ----------------------------------------------------------------------------
 
 
@@ -42,28 +133,337 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>	//contains isdigit function
-#include <math.h>	//contains pow function
+#include <limits.h>	//contains INT_MAX
+#include <time.h>	//contains clock_gettime
+// POSIX libs, for reading input files with mmap, for the batch pipeline and
+// for --serve
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// The reduction engine, libnestindex; only its public interface is used
+#include "nestindex.h"
+
+
+// Statistics of a run
+// With --stats, each word reduced gets an ni_stats, printed to stderr as a
+// line of JSON, and a run gets totals over its words and the wall time of
+// its phases.
+typedef struct run_stats {
+    ni_stats totals;		// Sums over words, largest peak
+    unsigned long long words;	// Words reduced
+    double start;		// Clock at start of run
+    double read;		// Seconds reading and parsing input
+    double reduce;		// Seconds reducing words
+    double write;		// Seconds writing output
+} run_stats;
+
+// Words of a text file are read and reduced in batches of BATCH_WORDS words.
+// With -i a batch also stops once its classes may hold CLASS_BATCH_ROOM
+// nesting indices.
+#define BATCH_WORDS 4096
+#define CLASS_BATCH_ROOM 16777216
+#define PIPELINE_BATCHES 4
+#define WRITE_BLOCK 1048576
+
+// Chars file_print_word formats before writing them
+#define WORD_TEXT_ROOM 4096
+
+// Word pool type
+// Letters of the words read, generated or kept by a run are taken from a
+// word pool, which hands them out from large blocks, so words need no
+// malloc of their own and all of them are freed at once. Blocks are kept on
+// reset for the next batch.
+typedef struct pool_block {
+    struct pool_block * next;
+    size_t capacity;		// Number of letters block holds
+    size_t used;		// Number of letters handed out
+    unsigned short letters[];
+} pool_block;
+
+typedef struct word_pool {
+    pool_block * first;
+    pool_block * current;	// Blocks after current are unused
+} word_pool;
+
+#define POOL_MIN_LETTERS 65536
+
+// Word set type
+// A set of words, used by --canonical to keep one word per class of input.
+// Open addressing with linear probing; capacity is a power of 2 and the set
+// grows when half full. Words are copied into pool and never removed.
+typedef struct word_set {
+    unsigned short ** words;
+    int * sizes;
+    unsigned int * hashes;
+    size_t capacity;
+    size_t count;
+    word_pool pool;
+} word_set;
+
+#define WORD_SET_MIN_SLOTS 1024
+
+// Enumeration type
+// --enumerate generates relabeled DOWs straight into batches of BATCH_WORDS
+// words. With --classes only the least word of each class of cyclically
+// equivalent words is kept, and the whole class is reduced from it. Counts
+// are indexed by NI (0 for NIs above bound), or by class size for
+// class_counts. Words of a class need not share an NI, so word_counts counts
+// every word of the class, and min_counts and max_counts count the class
+// under its least and greatest NI.
+typedef struct enumeration {
+    unsigned short ** words;
+    int * sizes;
+    int * NIs;
+    int ** class_NIs;		// With --classes, NIs of each class
+    int * class_sizes;
+    int count;			// Words in batch
+    word_pool pool;
+    ni_context * context;
+    short classes;		// Keep one word per class
+    unsigned long long * word_counts;
+    unsigned long long * min_counts;
+    unsigned long long * max_counts;
+    unsigned long long * class_counts;
+    short out_of_memory;	// Some word could not be reduced
+    unsigned long long cut_off;	// Words stopped by a limit
+} enumeration;
+
+
+// Cut-off types
+// Words of -t and -c stopped by a limit of options are kept, with the bounds
+// on their nesting indices, for the summary printed at the end of the run.
+// Their letters are copied into pool.
+typedef struct cut_off {
+    unsigned long long id;	// Index of word in input
+    unsigned short * word;
+    int size;
+    int limit;			// NI_LIMIT_* word hit
+    int lower_bound, upper_bound;
+} cut_off;
+
+typedef struct cut_off_list {
+    cut_off * entries;
+    size_t count, capacity;
+    unsigned long long by_limit[NI_LIMIT_MEMORY + 1];
+    word_pool pool;
+} cut_off_list;
+
+
+// Reader types
+// A word reader hands out the white-space delimited words of an input file
+// as pointers into the file's bytes. Regular files are mapped with mmap, so
+// words are never copied; other input (pipes, stdin) is read in chunks into
+// a buffer that grows to hold the longest word.
+typedef struct word_reader {
+    FILE * file;		// NULL if input is mapped
+    char * data;		// Mapped file or buffer
+    size_t length;		// Bytes in data
+    size_t pos;			// Next byte of data to read
+    size_t capacity;		// Size of buffer, 0 if input is mapped
+    short at_eof;		// No more bytes beyond data
+    short started;		// First digit of input has been found
+    short format;		// FORMAT_TEXT or a binary format
+} word_reader;
+
+// Binary corpus format
+// A binary DOW file starts with BINARY_DOW_MAGIC followed by one record per
+// word: a 32-bit header holding size << 1 | wide, then the size letters of
+// the word, one byte each, or two bytes each if wide is set. Words get one
+// byte letters when all their letters are below 256. A binary NI file starts
+// with BINARY_NI_MAGIC followed by one record per word of input: the index
+// of the word in input as a 64-bit int, then its nesting index (or
+// NI_NOT_DOW, NI_NO_MEMORY, NI_ABOVE_BOUND or NI_OVER_BUDGET) as a 32-bit
+// int. Ints are little-endian.
+#define BINARY_MAGIC_SIZE 8
+#define BINARY_DOW_MAGIC "NIDOW01\n"
+#define BINARY_NI_MAGIC "NINI001\n"
+#define BINARY_NI_RECORD 12
+
+#define FORMAT_TEXT 0
+#define FORMAT_BINARY_DOW 1
+#define FORMAT_BINARY_NI 2
+
+#define READER_CHUNK 1048576
+
+
+// Server types
+// --serve answers requests from stdin, or from the clients of a Unix socket.
+// A request is a line holding a word; its response is a line holding the
+// word as sent, its nesting index and the microseconds since the request
+// arrived. Clients may send many requests without waiting; each gets its
+// responses in order. Every complete line that has arrived, from all
+// clients, is reduced in one batch, so the context and its memo tables stay
+// warm between requests. Blank lines get no response.
+typedef struct server_client {
+    int fd;			// Requests are read from fd
+    FILE * out;			// Responses are written to out
+    short ended;		// No more requests will arrive
+    char * buffer;		// Bytes read and not yet answered
+    size_t start;		// Bytes before start are answered
+    size_t used, capacity;
+    double received;		// Clock when oldest unanswered line arrived
+} server_client;
+
+typedef struct server_request {
+    int client;			// Index of client in clients
+    size_t offset;		// Line in buffer of client
+    int length;
+    int word;			// Index in batch, -1 if line is not a word
+} server_request;
+
+#define SERVER_CHUNK 65536	// Bytes read from a client at once
+#define SERVER_MAX_LINE 1048576	// Longest request
+#define SERVER_MAX_CLIENTS 64
+
+
+// Command line options
+typedef struct run_options {
+    ni_options context;		// Memo budget, jobs, bound on NIs, engine
+    short memo_stats;
+    short binary_out;		// Write binary NI records for -t
+    short classes;		// Enumerate one word per class
+    short canonical;		// Reduce one word per class of -t and -c
+    short stats;		// Print statistics of words and run
+    short limited;		// Some limit on words is set
+    char * db_path;		// NI database of --db, or NULL
+    short db_read_only;
+} run_options;
+
+
+// Pipeline types
+// -t, -c and -i -t run as three stages that overlap: a reader thread parses
+// words into batches, the main thread reduces each batch on the jobs of the
+// context, and a writer thread prints their results. PIPELINE_BATCHES
+// batches circulate between the stages through batch queues, so a stage
+// that falls behind holds up the one feeding it. Output is fully buffered in
+// blocks of WRITE_BLOCK bytes, so the writer issues one write per block.
+typedef struct pipeline_batch {
+    unsigned short ** words;
+    int * sizes;
+    int * NIs;			// With -i, number of words of each class
+    int ** class_NIs;		// With -i, NIs of the class of each word
+    int * class_buffer;		// Room of class_NIs
+    size_t class_capacity;
+    ni_stats * stats;		// NULL unless --stats or a limit is set
+    int count;			// Words in batch
+    size_t room;		// With -i, NIs the classes of batch need
+    short last;			// Input ends with batch
+    word_pool pool;		// Letters of words
+} pipeline_batch;
+
+// A batch queue is a ring with one producer and one consumer. Positions only
+// grow and are published with release stores, so neither side takes a
+// lock. A queue never holds more than the PIPELINE_BATCHES batches there
+// are, so pushes never wait; a consumer finding the ring empty sleeps on
+// items, which counts the batches pushed and not yet popped.
+typedef struct batch_queue {
+    pipeline_batch * slots[PIPELINE_BATCHES];
+    atomic_uint head;		// Position of next batch to pop
+    atomic_uint tail;		// Position of next batch to push
+    sem_t items;
+} batch_queue;
+
+typedef struct pipeline {
+    word_reader * reader;
+    FILE * out;			// Output file, NULL for stdout
+    ni_context * context;
+    run_options * opts;
+    run_stats * run;		// Each stage times its own phase
+    short isos;			// Reduce the class of each word (-i -t)
+    short counting;		// Count NIs (-c) instead of printing them
+    batch_queue empty;		// Batches for the reader to fill
+    batch_queue filled;		// Batches to reduce
+    batch_queue reduced;	// Batches to write
+    pipeline_batch batches[PIPELINE_BATCHES];
+    word_set classes;		// Classes of input seen, with --canonical
+    short truncated;		// Input ended in the middle of a word
+    unsigned long long * counts;	// Counts of -c, as kept by add_count
+    int max_NI;
+    unsigned long long word_id;	// Index in input of next word written
+    cut_off_list cut_offs;
+} pipeline;
 
 
 // Function templates
-unsigned short ** step(unsigned short *, int, int *, int *);
-int get_NI(unsigned short *, int);
-unsigned short * get_letters(unsigned short *, int);
-int * occurrences(unsigned short *, int, unsigned short);
-short is_double_occurrence(unsigned short *, int);
-unsigned short ** sequences(unsigned short *, int, int *);
-unsigned short ** get_repeat_return_words(unsigned short *, int, int *);
-unsigned short * remove_seqs(unsigned short *, int, unsigned short **, int, int *);
-short is_in_seq(short, unsigned short **, int);
-unsigned short * remove_ltr(unsigned short *, int, unsigned short);
-unsigned short * relabel(unsigned short *, int);
+ni_context * create_context(run_options *);
+void free_context(ni_context *, run_options *);
+int parse_options(int, char **, run_options *);
+void usage_message();
+short add_count(unsigned long long **, int *, int, unsigned long long);
+int run_enumeration(int, ni_context *, run_options *);
+void enumerate_words(enumeration *, unsigned short *, int, int, int,
+		     unsigned char *);
+void flush_enumeration(enumeration *);
+int count_enumerated(enumeration *, int);
+int get_class_size(unsigned short *, int);
+short word_set_init(word_set *);
+short word_set_insert(word_set *, unsigned short *, int);
+void word_set_free(word_set *);
+unsigned short * get_word(char *, int *);
+short reader_open(word_reader *, const char *);
+short reader_next(word_reader *, const char **, int *);
+short reader_fill(word_reader *);
+short reader_ensure(word_reader *, size_t);
+void reader_detect_format(word_reader *);
+short read_word(word_reader *, word_pool *, unsigned short **, int *);
+short read_class_word(word_reader *, word_pool *, word_set *,
+		      unsigned short **, int *);
+void reader_close(word_reader *);
+void write_binary_word(FILE *, unsigned short *, int);
+void write_binary_NI(FILE *, unsigned long long, int);
+int convert_corpus(const char *, const char *, short);
+int run_server(const char *, ni_context *, run_options *);
+void server_signal(int);
+int server_listen(const char *);
+short server_add_client(server_client *, int *, int, FILE *);
+void server_drop_client(server_client *, int *, int);
+short server_read(server_client *);
+short server_next_line(server_client *, size_t *, int *);
+int server_take_requests(server_client *, int, server_request *,
+			 word_pool *, unsigned short **, int *);
+void server_respond(server_client *, int, server_request *, int, int *, int);
+void print_stats(FILE *, unsigned long long, int, int, ni_stats *);
+void print_run_stats(FILE *, run_stats *, const char *);
+double time_phase(double *, double);
 void print_word(unsigned short *, int, short);
+void print_NI(FILE *, int, int);
+void print_bounds(FILE *, ni_stats *);
+const char * limit_name(int);
+short cut_off_add(cut_off_list *, unsigned long long, unsigned short *, int,
+		  ni_stats *);
+void print_cut_offs(FILE *, cut_off_list *);
+void print_class(FILE *, int *, int, int);
+void print_class_NI(FILE *, int, int, const char *);
+int class_min(int *, int);
 void file_print_word(FILE *, unsigned short *, int, short);
-unsigned short * get_word(char *, int *);
-void copy_words(unsigned short **, int *, unsigned short **, int *, int *);
-void usage_message();
-unsigned short * get_reverse(unsigned short *, int);
-unsigned short ** get_isomorphisms(unsigned short *, int, int *);
+void pool_init(word_pool *);
+unsigned short * pool_alloc(word_pool *, int);
+void pool_reset(word_pool *);
+void pool_release(word_pool *);
+unsigned int hash_letters(unsigned short *, int);
+void add_word_stats(ni_stats *, ni_stats *);
+double wall_seconds(void);
+int format_letter(char *, unsigned int);
+void run_pipeline(pipeline *);
+void * pipeline_reader(void *);
+void * pipeline_writer(void *);
+void compute_batch(pipeline *, pipeline_batch *);
+void write_batch(pipeline *, pipeline_batch *);
+short batch_init(pipeline_batch *, short, short);
+void batch_free(pipeline_batch *);
+short queue_init(batch_queue *);
+void queue_push(batch_queue *, pipeline_batch *);
+pipeline_batch * queue_pop(batch_queue *);
 
 
 //// main function
@@ -71,22 +471,47 @@ unsigned short ** get_isomorphisms(unsigned short *, int, int *);
 // double occurrence words (DOWs) and prints result to console or outfile.
 int main(int argc, char * argv[])
 {
-    unsigned short ** isomorphisms;
-    unsigned short * word;
-    char word_string[256];
-    int counts[20];
-    int NI = 0, size = 0, i = 0, bufferchar = 0, count = 0;
-    FILE * InFile = NULL, * OutFile = NULL;
+    unsigned short * isomorphisms, * word;
+    int * class_NIs = NULL;
+    int NI = 0, size = 0, i = 0;
+    short InFileOpen = 0, isos = 0;
+    word_reader InFile;
+    pipeline pipe;
+    FILE * OutFile = NULL;
+    ni_context * context = NULL;
+    run_options opts;
+    ni_stats word_stats;
+    run_stats run;
+    char * end = NULL;
 	
-    for(i = 0; i < 20; i++) counts[i] = 0;
-    for(i = 0; i < 256; i++) word_string[i] = (char) 0;
+    argc = parse_options(argc, argv, &opts);
+    memset(&run, 0, sizeof(run_stats));
+    run.start = wall_seconds();
+    context = create_context(&opts);
 	
+    // -i before -t reduces the class of each word of input
+    if(argc > 3 && (!strcmp(argv[1], "-i") || !strcmp(argv[1], "--isos")) &&
+       (!strcmp(argv[2], "-t") || !strcmp(argv[2], "--text"))){
+	isos = 1;
+	for(i = 1; i < argc; i++) argv[i] = argv[i + 1];
+	argc--;
+	if(opts.binary_out){
+	    printf("Binary NI records can't hold classes, use -t without -i \r\n");
+	    exit(1);
+	}
+    }
+
     if(argc < 2 || argc > 4){  // Too little or too many arguments
 	usage_message();
     }
     else if(argc == 2){	// Input is direct word or help is desired
 	if(!(strncmp(argv[1], "-h", 2)) || !(strncmp(argv[1], "--help", 6)))
 	    usage_message();
+	else if(!strcmp(argv[1], "--serve")){	// Requests from stdin
+	    i = run_server(NULL, context, &opts);
+	    free_context(context, &opts);
+	    return i;
+	}
 	else{
 	    size = strlen(argv[1]);
 	    // Converts chars to ints (shorts)
@@ -98,11 +523,26 @@ int main(int argc, char * argv[])
 	    }
 	    word = get_word(argv[1], &size);
 
-	    NI = get_NI(word, size);
+	    NI = ni_compute(context, word, size,
+			    (opts.stats || opts.limited)? &word_stats: NULL);
+	    if(opts.stats){
+		run.reduce = word_stats.seconds;
+		run.words = 1;
+		add_word_stats(&run.totals, &word_stats);
+		print_stats(stderr, 0, size, NI, &word_stats);
+		print_run_stats(stderr, &run, "word");
+	    }
 	    print_word(word, size, 0);  // 0 means don't print \r\n
-	    if(NI == -1) printf(": not DOW \r\n");
+	    if(NI == NI_NOT_DOW) printf(": not DOW \r\n");
+	    else if(NI == NI_NO_MEMORY) printf(": out of memory \r\n");
+	    else if(NI == NI_ABOVE_BOUND) printf(": > %d \r\n", opts.context.bound);
+	    else if(NI == NI_OVER_BUDGET){
+		printf(": ");
+		print_bounds(stdout, &word_stats);
+	    }
 	    else printf(": %d \r\n", NI);
 	    free(word);
+	    free_context(context, &opts);
 	    return 0;
 	}
     }
@@ -110,7 +550,7 @@ int main(int argc, char * argv[])
 	if(!(strncmp(argv[1], "-t",2)) || !(strncmp(argv[1], "--text", 6)) || \
 	   !(strncmp(argv[1], "-c", 2)) || !(strncmp(argv[1], "--count", 7))){	
 	    // Text file input
-	    InFile = fopen(argv[2], "r");
+	    InFileOpen = reader_open(&InFile, argv[2]);
 	}
 	else if(!(strncmp(argv[1], "-i", 2)) || !(strncmp(argv[1], "--isos", 6))){
 	    size = strlen(argv[2]);
@@ -123,25 +563,79 @@ int main(int argc, char * argv[])
 	    }
 	    word = get_word(argv[2], &size);
 			
-	    isomorphisms = get_isomorphisms(word, size, &count);	
-	    for(i = 0; i < count; i++){
-		NI = get_NI(isomorphisms[i], size);
-		print_word(isomorphisms[i], size, 0);
-		printf(": %d\r\n", NI);
-		free(isomorphisms[i]);
+	    // +1 so that the empty word gets memory too
+	    isomorphisms = (unsigned short *) \
+		malloc(sizeof(unsigned short)*(NI_ISOMORPHISMS_ROOM(size) + 1));
+	    if(isomorphisms == NULL){
+		printf("Memory could not be alloc'd for isomorphisms");
+		exit(1);
+	    }
+	    ni_isomorphisms(word, size, isomorphisms);
+	    // Words of class are reduced together
+	    class_NIs = (int *) malloc(sizeof(int)*NI_CLASS_ROOM(size));
+	    if(class_NIs == NULL){
+		printf("Memory could not be alloc'd for isomorphisms");
+		exit(1);
+	    }
+	    ni_compute_classes(context, (const unsigned short * const *) &word,
+			       &size, 1, &class_NIs, &NI,
+			       opts.stats? &word_stats: NULL);
+	    if(opts.stats){
+		run.reduce = word_stats.seconds;
+		run.words = 1;
+		add_word_stats(&run.totals, &word_stats);
+		print_stats(stderr, 0, size, class_min(class_NIs, NI),
+			    &word_stats);
+		print_run_stats(stderr, &run, "-i");
+	    }
+	    if(NI == NI_NO_MEMORY){
+		printf("Memory could not be alloc'd for class of word ");
+		print_word(word, size, 1);
 	    }
+	    else if(class_NIs[0] == NI_NOT_DOW){
+		print_word(word, size, 0);
+		printf(": not DOW \r\n");
+	    }
+	    // Words of class come in the order of ni_isomorphisms
+	    for(i = 0; i < NI && class_NIs[0] != NI_NOT_DOW; i++){
+		print_word(isomorphisms + (size_t) i*size, size, 0);
+		printf(": ");
+		print_NI(stdout, class_NIs[i], opts.context.bound);
+	    }
+	    free(class_NIs);
 	    free(isomorphisms);
 	    free(word);
+	    free_context(context, &opts);
 	    return 0;
 	}
+	else if(!strcmp(argv[1], "--enumerate")){
+	    size = (int) strtol(argv[2], &end, 10);
+	    if(*end != '\0' || size < 1 || size > USHRT_MAX/2){
+		printf("Number of letters was not recognized \r\n");
+		usage_message();
+	    }
+	    i = run_enumeration(size, context, &opts);
+	    free_context(context, &opts);
+	    return i;
+	}
+	else if(!strcmp(argv[1], "--serve")){	// Requests from a socket
+	    i = run_server(argv[2], context, &opts);
+	    free_context(context, &opts);
+	    return i;
+	}
 	else{
 	    printf("Error interpreting input \r\n");
 	    usage_message();
 	}
     }
     else if(argc == 4){
-	if(!(strncmp(argv[1], "-t",2)) || !(strncmp(argv[1], "--text", 6))){
-	    InFile = fopen(argv[2], "r");
+	if(!strcmp(argv[1], "--to-binary") || !strcmp(argv[1], "--to-text")){
+	    free_context(context, &opts);
+	    return convert_corpus(argv[2], argv[3],
+				  !strcmp(argv[1], "--to-binary"));
+	}
+	else if(!(strncmp(argv[1], "-t",2)) || !(strncmp(argv[1], "--text", 6))){
+	    InFileOpen = reader_open(&InFile, argv[2]);
 	    OutFile = fopen(argv[3], "w");
 	}
 	else{
@@ -150,7 +644,7 @@ int main(int argc, char * argv[])
 	}
     }
     // Check that files specified are good
-    if(InFile == NULL){
+    if(!InFileOpen){
 	printf("Couldn't open file: %s \r\n", argv[2]);
 	exit(1);
     }
@@ -158,55 +652,861 @@ int main(int argc, char * argv[])
 	printf("Couldn't open file: %s \r\n", argv[3]);
 	exit(1);
     }
-    // Gets to first number in file
+    if(InFile.format == FORMAT_BINARY_NI){
+	printf("File holds nesting indices, not words: %s \r\n", argv[2]);
+	exit(1);
+    }
+    setvbuf((OutFile == NULL)? stdout: OutFile, NULL, _IOFBF, WRITE_BLOCK);
+    if(opts.binary_out){
+	if(OutFile == NULL) OutFile = stdout;
+	fwrite(BINARY_NI_MAGIC, 1, BINARY_MAGIC_SIZE, OutFile);
+    }
+    // Words are read, reduced and written by the stages of a pipeline
+    pipe.reader = &InFile;
+    pipe.out = OutFile;
+    pipe.context = context;
+    pipe.opts = &opts;
+    pipe.run = &run;
+    pipe.isos = isos;
+    pipe.counting = !(strncmp(argv[1], "-c", 2)) ||
+	!(strncmp(argv[1], "--count", 7));
+    run_pipeline(&pipe);
+    if(pipe.truncated)
+	printf("Input ended in the middle of a word: %s \r\n", argv[2]);
+    if(pipe.counting){
+	for(i = 1; i <= pipe.max_NI; i++){
+	    if(pipe.counts[i] != 0)
+		printf("NI = %d: %llu\r\n", i, pipe.counts[i]);
+	}
+	if(pipe.counts != NULL && pipe.counts[0] != 0)
+	    printf("NI > %d: %llu\r\n", opts.context.bound, pipe.counts[0]);
+	if(pipe.cut_offs.count != 0)
+	    printf("Cut off: %lu\r\n", (unsigned long) pipe.cut_offs.count);
+	free(pipe.counts);
+    }
+    print_cut_offs(stderr, &pipe.cut_offs);
+    free(pipe.cut_offs.entries);
+    pool_release(&pipe.cut_offs.pool);
+    reader_close(&InFile);
+    if(OutFile != NULL && OutFile != stdout) fclose(OutFile);
+    if(opts.stats) print_run_stats(stderr, &run, isos? "-i -t": argv[1]);
+    free_context(context, &opts);
+    return 0;
+}
+
+
+//// run_pipeline function
+// Given a pipeline whose reader, output, context, options, run stats and
+// mode are set, reads, reduces and writes all words of input, with reader
+// and writer threads overlapping the reduction on the calling thread (see
+// Pipeline types). Counts of -c, words cut off by a limit and whether input
+// was truncated are left in pipe. Exits if memory or threads could not be
+// alloc'd.
+void run_pipeline(pipeline * pipe)
+{
+    pthread_t reader, writer;
+    pipeline_batch * batch = NULL;
+    double start = 0;
+    short last = 0;
+    int i = 0;
+
+    pipe->counts = NULL;
+    pipe->max_NI = 0;
+    pipe->word_id = 0;
+    pipe->truncated = 0;
+    memset(&pipe->cut_offs, 0, sizeof(cut_off_list));
+    pool_init(&pipe->cut_offs.pool);
+    if(!queue_init(&pipe->empty) || !queue_init(&pipe->filled) ||
+       !queue_init(&pipe->reduced) ||
+       (pipe->opts->canonical && !word_set_init(&pipe->classes))){
+	printf("Memory could not be alloc'd for batch");
+	exit(1);
+    }
+    for(i = 0; i < PIPELINE_BATCHES; i++){
+	// Bounds of words stopped by a limit come in their stats
+	if(!batch_init(&pipe->batches[i], pipe->isos,
+		       pipe->opts->stats || pipe->opts->limited)){
+	    printf("Memory could not be alloc'd for batch");
+	    exit(1);
+	}
+	queue_push(&pipe->empty, &pipe->batches[i]);
+    }
+    if(pthread_create(&reader, NULL, pipeline_reader, pipe) != 0 ||
+       pthread_create(&writer, NULL, pipeline_writer, pipe) != 0){
+	printf("Threads could not be started for batch");
+	exit(1);
+    }
+    do{
+	batch = queue_pop(&pipe->filled);
+	start = wall_seconds();
+	compute_batch(pipe, batch);
+	if(pipe->opts->stats) time_phase(&pipe->run->reduce, start);
+	last = batch->last;	// Batch is the writer's once pushed
+	queue_push(&pipe->reduced, batch);
+    } while(!last);
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    for(i = 0; i < PIPELINE_BATCHES; i++) batch_free(&pipe->batches[i]);
+    sem_destroy(&pipe->empty.items);
+    sem_destroy(&pipe->filled.items);
+    sem_destroy(&pipe->reduced.items);
+    if(pipe->opts->canonical) word_set_free(&pipe->classes);
+}
+
+//// pipeline_reader function
+// Reader stage of a pipeline (arg): fills empty batches with words of input
+// and hands them on to be reduced, until input ends. The batch input ends
+// with is marked last, and may hold no words.
+void * pipeline_reader(void * arg)
+{
+    pipeline * pipe = (pipeline *) arg;
+    pipeline_batch * batch = NULL;
+    word_set * classes = pipe->opts->canonical? &pipe->classes: NULL;
+    double start = 0;
+    short more_words = 1;
+
     do{
-	bufferchar = fgetc(InFile);
-    } while(!isdigit(bufferchar) && bufferchar != EOF);
+	batch = queue_pop(&pipe->empty);
+	start = wall_seconds();
+	pool_reset(&batch->pool);
+	batch->count = 0;
+	batch->room = 0;
+	// Batches of classes also stop at CLASS_BATCH_ROOM nesting indices
+	while(batch->count < BATCH_WORDS &&
+	      (!pipe->isos || batch->room < CLASS_BATCH_ROOM) &&
+	      (more_words = read_class_word(pipe->reader, &batch->pool,
+					    classes, &batch->words[batch->count],
+					    &batch->sizes[batch->count])) > 0){
+	    batch->room += NI_CLASS_ROOM(batch->sizes[batch->count]);
+	    batch->count++;
+	}
+	batch->last = (more_words <= 0);
+	pipe->truncated = (more_words < 0);
+	if(pipe->opts->stats) time_phase(&pipe->run->read, start);
+	queue_push(&pipe->filled, batch);
+    } while(more_words > 0);
+    return NULL;
+}
 
-    // Goes till end of file
-    while(bufferchar != EOF){
-	size = 0;
-	// Gets word and puts to word_string
-	while(!isspace(bufferchar) && bufferchar != EOF){
-	    word_string[size++] = (char) bufferchar;
-	    bufferchar = fgetc(InFile);
+//// pipeline_writer function
+// Writer stage of a pipeline (arg): writes the results of reduced batches
+// in input order and gives the batches back to the reader, until the last
+// batch. Statistics of words are printed but not timed.
+void * pipeline_writer(void * arg)
+{
+    pipeline * pipe = (pipeline *) arg;
+    pipeline_batch * batch = NULL;
+    double start = 0;
+    short last = 0;
+    int i = 0;
+
+    do{
+	batch = queue_pop(&pipe->reduced);
+	start = wall_seconds();
+	write_batch(pipe, batch);
+	if(pipe->opts->stats){
+	    time_phase(&pipe->run->write, start);
+	    for(i = 0; i < batch->count; i++){
+		add_word_stats(&pipe->run->totals, &batch->stats[i]);
+		print_stats(stderr, pipe->run->words++, batch->sizes[i],
+			    pipe->isos? class_min(batch->class_NIs[i],
+						  batch->NIs[i]):
+			    batch->NIs[i], &batch->stats[i]);
+	    }
 	}
-	word = get_word(word_string, &size);
-	NI = get_NI(word, size);
+	last = batch->last;
+	if(!last) queue_push(&pipe->empty, batch);
+    } while(!last);
+    fflush((pipe->out == NULL)? stdout: pipe->out);
+    return NULL;
+}
+
+//// compute_batch function
+// Given a pipeline and a batch read by it, stores the nesting index of each
+// word of batch (with -i, of each word of its class) and their stats.
+// Exits if memory could not be alloc'd.
+void compute_batch(pipeline * pipe, pipeline_batch * batch)
+{
+    int i = 0;
+
+    if(batch->count == 0) return;
+    if(!pipe->isos){
+	ni_compute_batch(pipe->context,
+			 (const unsigned short * const *) batch->words,
+			 batch->sizes, batch->count, batch->NIs, batch->stats);
+	return;
+    }
+    // NIs get the number of words of each class
+    if(batch->room > batch->class_capacity){
+	free(batch->class_buffer);
+	batch->class_buffer = (int *) malloc(sizeof(int)*batch->room);
+	batch->class_capacity = batch->room;
+    }
+    if(batch->class_buffer == NULL){
+	printf("Memory could not be alloc'd for classes");
+	exit(1);
+    }
+    batch->class_NIs[0] = batch->class_buffer;
+    for(i = 1; i < batch->count; i++)
+	batch->class_NIs[i] = batch->class_NIs[i - 1] +
+	    NI_CLASS_ROOM(batch->sizes[i - 1]);
+    ni_compute_classes(pipe->context,
+		       (const unsigned short * const *) batch->words,
+		       batch->sizes, batch->count, batch->class_NIs,
+		       batch->NIs, batch->stats);
+}
+
+//// write_batch function
+// Given a pipeline and a reduced batch, writes each word of batch with its
+// nesting index (or bounds, or class) to the output of pipe, or adds it to
+// the counts of -c, and keeps the words cut off by a limit. Exits if memory
+// could not be alloc'd.
+void write_batch(pipeline * pipe, pipeline_batch * batch)
+{
+    FILE * out = (pipe->out == NULL)? stdout: pipe->out;
+    unsigned short * word = NULL;
+    int i = 0, NI = 0, size = 0, bound = pipe->opts->context.bound;
+
+    for(i = 0; i < batch->count; i++){
+	word = batch->words[i];
+	size = batch->sizes[i];
+	NI = batch->NIs[i];
 
 	// Outputs word and nesting index
-	if(NI != 0){
-	    if(!(strncmp(argv[1], "-c", 2)) || !(strncmp(argv[1], "--count", 7))){
-		if(NI > sizeof(counts)/sizeof(counts[0])){
-		    printf("'-c' cannot be used for words with such large NI\\r\n");
-		    printf("Try altering code to resize counts array");
-		    exit(1);
-                }
-		counts[NI - 1] += 1;
+	if(pipe->isos && NI != NI_NO_MEMORY){
+	    file_print_word(out, word, size, 0);
+	    fprintf(out, ": ");
+	    print_class(out, batch->class_NIs[i], NI, bound);
+	}
+	else if(pipe->opts->binary_out)
+	    write_binary_NI(out, pipe->word_id + i, NI);
+	else if(NI == NI_NO_MEMORY){
+	    // Counts have no line per word, so -c reports it on stderr
+	    if(pipe->counting){
+		fprintf(stderr, "Memory could not be alloc'd for word ");
+		file_print_word(stderr, word, size, 1);
 	    }
 	    else{
-		if(OutFile == NULL){	// Print to console
-		    print_word(word, size, 0);
-		    printf(": %d\r\n", NI);
-		}
-		else{	// Print to file
-		    file_print_word(OutFile, word, size, 0);
-		    fprintf(OutFile, ": %d\r\n", NI);
+		file_print_word(out, word, size, 0);
+		fprintf(out, ": memory could not be alloc'd\r\n");
+	    }
+	}
+	else if(NI != 0){
+	    if(pipe->counting){
+		// NIs above bound are counted at 0; words cut off are only
+		// summed up and words that are not DOWs are not counted
+		if(NI < 0 && NI != NI_ABOVE_BOUND) continue;
+		if(!add_count(&pipe->counts, &pipe->max_NI,
+			      (NI == NI_ABOVE_BOUND)? 0: NI, 1)){
+		    fprintf(stderr, "Memory could not be alloc'd for counts\r\n");
+		    exit(1);
 		}
 	    }
+	    else{
+		file_print_word(out, word, size, 0);
+		fprintf(out, ": ");
+		if(NI == NI_OVER_BUDGET) print_bounds(out, &batch->stats[i]);
+		else print_NI(out, NI, bound);
+	    }
 	}
-	free(word);
-	if(bufferchar != EOF) bufferchar = fgetc(InFile);
     }
-    if(!(strncmp(argv[1], "-c", 2)) || !(strncmp(argv[1], "--count", 7))){
-	for(i = 0; i < 20; i++){
-	    if(counts[i] != 0)
-		printf("NI = %d: %d\r\n", i+1, counts[i]);
+    for(i = 0; i < batch->count && !pipe->isos; i++){
+	if(batch->NIs[i] == NI_OVER_BUDGET &&
+	   !cut_off_add(&pipe->cut_offs, pipe->word_id + i, batch->words[i],
+			batch->sizes[i], &batch->stats[i])){
+	    fprintf(stderr, "Memory could not be alloc'd for words cut off\r\n");
+	    exit(1);
 	}
     }
-    fclose(InFile);
-    if(OutFile != NULL) fclose(OutFile);
-    return 0;
+    pipe->word_id += batch->count;
+}
+
+//// batch_init function
+// Given a batch of a pipeline, whether it reduces classes and whether it
+// keeps stats, allocs room for BATCH_WORDS words. Returns 0 if memory could
+// not be alloc'd, else 1.
+short batch_init(pipeline_batch * batch, short isos, short stats)
+{
+    memset(batch, 0, sizeof(pipeline_batch));
+    pool_init(&batch->pool);
+    batch->words = (unsigned short **) malloc(sizeof(unsigned short *)*BATCH_WORDS);
+    batch->sizes = (int *) malloc(sizeof(int)*BATCH_WORDS);
+    batch->NIs = (int *) malloc(sizeof(int)*BATCH_WORDS);
+    if(stats)
+	batch->stats = (ni_stats *) malloc(sizeof(ni_stats)*BATCH_WORDS);
+    if(isos)
+	batch->class_NIs = (int **) malloc(sizeof(int *)*BATCH_WORDS);
+    return (batch->words != NULL && batch->sizes != NULL &&
+	    batch->NIs != NULL && (!stats || batch->stats != NULL) &&
+	    (!isos || batch->class_NIs != NULL));
+}
+
+//// batch_free function
+// Frees the room of a batch of a pipeline.
+void batch_free(pipeline_batch * batch)
+{
+    pool_release(&batch->pool);
+    free(batch->words);
+    free(batch->sizes);
+    free(batch->NIs);
+    free(batch->class_NIs);
+    free(batch->class_buffer);
+    free(batch->stats);
+}
+
+//// queue_init function
+// Empties a batch queue. Returns 0 if its semaphore could not be made,
+// else 1.
+short queue_init(batch_queue * queue)
+{
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return (sem_init(&queue->items, 0, 0) == 0);
+}
+
+//// queue_push function
+// Given a batch queue and a batch, adds batch at the tail of queue. Only
+// the producer of queue may call it.
+void queue_push(batch_queue * queue, pipeline_batch * batch)
+{
+    unsigned int tail = atomic_load_explicit(&queue->tail,
+					     memory_order_relaxed);
+
+    queue->slots[tail % PIPELINE_BATCHES] = batch;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    sem_post(&queue->items);
+}
+
+//// queue_pop function
+// Given a batch queue, removes and returns the batch at its head, waiting
+// for one if queue is empty. Only the consumer of queue may call it.
+pipeline_batch * queue_pop(batch_queue * queue)
+{
+    unsigned int head = atomic_load_explicit(&queue->head,
+					     memory_order_relaxed);
+    pipeline_batch * batch = NULL;
+
+    // The ring is only waited on when empty
+    if(atomic_load_explicit(&queue->tail, memory_order_acquire) == head)
+	while(sem_wait(&queue->items) != 0);
+    else
+	while(sem_trywait(&queue->items) != 0);
+    atomic_thread_fence(memory_order_acquire);
+    batch = queue->slots[head % PIPELINE_BATCHES];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return batch;
+}
+
+
+//// create_context function
+// Given run options, returns a context computing nesting indices with
+// opts->context, whose memo tables split opts->context.memo_budget among
+// opts->context.jobs threads, and opens the database of opts->db_path. Exits
+// if memory could not be alloc'd or database could not be opened.
+ni_context * create_context(run_options * opts)
+{
+    ni_context * context = ni_context_create(&opts->context);
+    ni_memo_counts counts;
+    int code = NI_OK;
+
+    if(context == NULL){
+	printf("Memory could not be alloc'd for context");
+	exit(1);
+    }
+    if(opts->db_path != NULL)
+	code = ni_context_open_db(context, opts->db_path, opts->db_read_only);
+    if(code != NI_OK){
+	printf("Couldn't open database %s: %s \r\n", opts->db_path,
+	       ni_error_string(code));
+	exit(1);
+    }
+    ni_memo_stats(context, &counts);
+    if(opts->context.memo_budget > 0 && counts.tables < opts->context.jobs)
+	fprintf(stderr, "Memo could not be alloc'd, running without\r\n");
+    return context;
+}
+
+//// free_context function
+// Given a context made by create_context and run options, prints the
+// statistics of its memo tables if asked for and frees it.
+void free_context(ni_context * context, run_options * opts)
+{
+    ni_memo_counts counts;
+
+    if(opts->memo_stats && opts->context.memo_budget > 0){
+	ni_memo_stats(context, &counts);
+	fprintf(stderr, "memo: %lu hits, %lu misses, %lu evictions, "
+		"%lu entries, %lu bytes\r\n", counts.hits, counts.misses,
+		counts.evictions, counts.entries, counts.bytes);
+	if(counts.shared_bytes > 0)
+	    fprintf(stderr, "shared memo: %lu hits, %lu misses, %lu evictions, "
+		    "%lu entries, %lu bytes\r\n", counts.shared_hits,
+		    counts.shared_misses, counts.shared_evictions,
+		    counts.shared_entries, counts.shared_bytes);
+    }
+    if(opts->memo_stats && opts->db_path != NULL){
+	ni_memo_stats(context, &counts);
+	fprintf(stderr, "db: %lu hits, %lu misses, %llu entries\r\n",
+		counts.db_hits, counts.db_misses, counts.db_entries);
+    }
+    ni_context_free(context);
+}
+
+
+//// add_count function
+// Given a pointer to an array of counts, a pointer to its largest index, an
+// index and an amount, adds amount to count at index, growing array (with
+// new counts 0) if index is beyond it. Returns 0 if memory could not be
+// alloc'd, else 1.
+short add_count(unsigned long long ** counts, int * max_index, int index,
+		unsigned long long amount)
+{
+    unsigned long long * grown = NULL;
+    int i = 0;
+
+    if(index > *max_index || *counts == NULL){
+	grown = (unsigned long long *) realloc(*counts,
+					       sizeof(unsigned long long)*(index + 1));
+	if(grown == NULL) return 0;
+	for(i = (*counts == NULL)? 0: *max_index + 1; i <= index; i++)
+	    grown[i] = 0;
+	*counts = grown;
+	*max_index = index;
+    }
+    (*counts)[index] += amount;
+    return 1;
+}
+
+
+//// run_enumeration function
+// Given a number of letters n, a context and run options, reduces every
+// relabeled DOW with n letters (a class at a time if opts->classes) and
+// prints counts of words, classes and class sizes. Returns exit status
+// for main.
+int run_enumeration(int letters, ni_context * context, run_options * opts)
+{
+    enumeration enumer;
+    unsigned short word[2*letters];
+    unsigned char seen[letters + 1];
+    int max_NI = 0, max_class = 0, i = 0;
+
+    enumer.words = (unsigned short **) malloc(sizeof(unsigned short *)*BATCH_WORDS);
+    enumer.sizes = (int *) malloc(sizeof(int)*BATCH_WORDS);
+    enumer.NIs = (int *) malloc(sizeof(int)*BATCH_WORDS);
+    enumer.class_sizes = (int *) malloc(sizeof(int)*BATCH_WORDS);
+    enumer.class_NIs = NULL;
+    if(opts->classes){
+	enumer.class_NIs = (int **) malloc(sizeof(int *)*BATCH_WORDS);
+	if(enumer.class_NIs != NULL){
+	    enumer.class_NIs[0] = (int *) malloc(sizeof(int)*BATCH_WORDS*
+						 NI_CLASS_ROOM(2*letters));
+	    for(i = 1; i < BATCH_WORDS && enumer.class_NIs[0] != NULL; i++)
+		enumer.class_NIs[i] = enumer.class_NIs[i - 1] +
+		    NI_CLASS_ROOM(2*letters);
+	}
+    }
+    enumer.word_counts = enumer.min_counts = enumer.max_counts = NULL;
+    enumer.class_counts = NULL;
+    if(enumer.words == NULL || enumer.sizes == NULL || enumer.NIs == NULL ||
+       enumer.class_sizes == NULL ||
+       (opts->classes &&
+	(enumer.class_NIs == NULL || enumer.class_NIs[0] == NULL)) ||
+       !add_count(&enumer.word_counts, &max_NI, letters, 0) ||
+       !add_count(&enumer.min_counts, &max_NI, letters, 0) ||
+       !add_count(&enumer.max_counts, &max_NI, letters, 0) ||
+       !add_count(&enumer.class_counts, &max_class, 4*letters, 0)){
+	printf("Memory could not be alloc'd for enumeration");
+	exit(1);
+    }
+    pool_init(&enumer.pool);
+    enumer.count = 0;
+    enumer.context = context;
+    enumer.classes = opts->classes;
+    enumer.out_of_memory = 0;
+    enumer.cut_off = 0;
+    for(i = 0; i <= letters; i++) seen[i] = 0;
+
+    enumerate_words(&enumer, word, 2*letters, 0, 1, seen);
+    flush_enumeration(&enumer);
+
+    for(i = 1; i <= max_NI; i++){
+	if(enumer.word_counts[i] == 0) continue;
+	if(enumer.classes)
+	    printf("NI = %d: %llu words, least of %llu classes, greatest of "
+		   "%llu\r\n", i, enumer.word_counts[i], enumer.min_counts[i],
+		   enumer.max_counts[i]);
+	else printf("NI = %d: %llu\r\n", i, enumer.word_counts[i]);
+    }
+    if(enumer.word_counts[0] != 0){
+	if(enumer.classes)
+	    printf("NI > %d: %llu words, least of %llu classes, greatest of "
+		   "%llu\r\n", opts->context.bound, enumer.word_counts[0],
+		   enumer.min_counts[0], enumer.max_counts[0]);
+	else printf("NI > %d: %llu\r\n", opts->context.bound,
+		    enumer.word_counts[0]);
+    }
+    if(enumer.classes){
+	for(i = 1; i <= max_class; i++){
+	    if(enumer.class_counts[i] != 0)
+		printf("Class size %d: %llu\r\n", i, enumer.class_counts[i]);
+	}
+    }
+    if(enumer.cut_off != 0)
+	printf("Cut off by a limit: %llu\r\n", enumer.cut_off);
+    if(enumer.out_of_memory)
+	printf("Memory could not be alloc'd for some words \r\n");
+
+    pool_release(&enumer.pool);
+    free(enumer.words);
+    free(enumer.sizes);
+    free(enumer.NIs);
+    free(enumer.class_sizes);
+    if(enumer.class_NIs != NULL) free(enumer.class_NIs[0]);
+    free(enumer.class_NIs);
+    free(enumer.word_counts);
+    free(enumer.min_counts);
+    free(enumer.max_counts);
+    free(enumer.class_counts);
+    return enumer.out_of_memory;
+}
+
+
+//// enumerate_words function
+// Given an enumeration, a word being built with its full size, the number of
+// letters placed so far, the next new letter and the number of times each
+// letter has been placed, places every letter that may come next and
+// recurses, adding each finished word to batch of enumeration. Letters
+// appear first in increasing order, so every word is relabeled.
+void enumerate_words(enumeration * enumer, unsigned short * word, int size,
+		     int placed, int next_letter, unsigned char * seen)
+{
+    int letter = 0, class_size = 0;
+
+    if(placed == size){
+	if(enumer->classes){
+	    class_size = get_class_size(word, size);
+	    if(class_size == 0) return;
+	}
+	enumer->words[enumer->count] = pool_alloc(&enumer->pool, size);
+	if(enumer->words[enumer->count] == NULL){
+	    printf("Memory could not be alloc'd for word");
+	    exit(1);
+	}
+	memcpy(enumer->words[enumer->count], word, sizeof(short)*size);
+	enumer->sizes[enumer->count] = size;
+	enumer->class_sizes[enumer->count] = class_size;
+	if(++enumer->count == BATCH_WORDS) flush_enumeration(enumer);
+	return;
+    }
+    // Second occurrence of a letter placed once
+    for(letter = 1; letter < next_letter; letter++){
+	if(seen[letter] != 1) continue;
+	seen[letter] = 2;
+	word[placed] = letter;
+	enumerate_words(enumer, word, size, placed + 1, next_letter, seen);
+	seen[letter] = 1;
+    }
+    // First occurrence of a new letter
+    if(2*next_letter <= size){
+	seen[next_letter] = 1;
+	word[placed] = next_letter;
+	enumerate_words(enumer, word, size, placed + 1, next_letter + 1, seen);
+	seen[next_letter] = 0;
+    }
+}
+
+
+//// flush_enumeration function
+// Given an enumeration, reduces words (or classes) of its batch, adds their
+// NIs to counts and empties batch.
+void flush_enumeration(enumeration * enumer)
+{
+    int i = 0, j = 0, NI = 0, min = 0, max = 0;
+
+    if(enumer->classes){
+	ni_compute_classes(enumer->context,
+			   (const unsigned short * const *) enumer->words,
+			   enumer->sizes, enumer->count, enumer->class_NIs,
+			   enumer->class_sizes, NULL);
+	for(i = 0; i < enumer->count; i++){
+	    if(enumer->class_sizes[i] < 1){
+		enumer->out_of_memory = 1;
+		continue;
+	    }
+	    // NIs above bound are greatest, and are counted at 0
+	    min = INT_MAX;
+	    max = 0;
+	    for(j = 0; j < enumer->class_sizes[i]; j++){
+		NI = count_enumerated(enumer, enumer->class_NIs[i][j]);
+		if(NI < 0) break;
+		if(NI == 0) NI = INT_MAX;
+		if(NI < min) min = NI;
+		if(NI > max) max = NI;
+	    }
+	    for(j++; j < enumer->class_sizes[i]; j++)
+		count_enumerated(enumer, enumer->class_NIs[i][j]);
+	    if(NI < 0) continue;
+	    enumer->min_counts[(min == INT_MAX)? 0: min]++;
+	    enumer->max_counts[(max == INT_MAX)? 0: max]++;
+	    enumer->class_counts[enumer->class_sizes[i]]++;
+	}
+    }
+    else{
+	ni_compute_batch(enumer->context,
+			 (const unsigned short * const *) enumer->words,
+			 enumer->sizes, enumer->count, enumer->NIs, NULL);
+	for(i = 0; i < enumer->count; i++)
+	    count_enumerated(enumer, enumer->NIs[i]);
+    }
+    enumer->count = 0;
+    pool_reset(&enumer->pool);
+}
+
+//// count_enumerated function
+// Given an enumeration and the NI (or error) of one of its words, adds word
+// to counts of enumeration. Returns index of the count, 0 if NI is above
+// bound, or -1 if word was cut off by a limit or not reduced.
+int count_enumerated(enumeration * enumer, int NI)
+{
+    if(NI == NI_ABOVE_BOUND) NI = 0;
+    else if(NI == NI_OVER_BUDGET){
+	enumer->cut_off++;
+	return -1;
+    }
+    else if(NI < 1){
+	enumer->out_of_memory = 1;
+	return -1;
+    }
+    enumer->word_counts[NI]++;
+    return NI;
+}
+
+
+//// get_class_size function
+// Given a relabeled word and its size, returns the number of words that are
+// cyclically equivalent to it (as in ni_isomorphisms) if it is the
+// canonical word of its class, else 0.
+int get_class_size(unsigned short * word, int size)
+{
+    unsigned short canonical[size];
+    int class_size = 0;
+
+    class_size = ni_canonical(word, size, canonical);
+    if(class_size < 1 ||
+       memcmp(canonical, word, sizeof(short)*size) != 0) return 0;
+    return class_size;
+}
+
+
+//// word_set_init function
+// Given a word set, allocs an empty set. Returns 0 if memory could not be
+// alloc'd, else 1.
+short word_set_init(word_set * set)
+{
+    set->capacity = WORD_SET_MIN_SLOTS;
+    set->count = 0;
+    set->words = (unsigned short **) calloc(set->capacity,
+					   sizeof(unsigned short *));
+    set->sizes = (int *) malloc(sizeof(int)*set->capacity);
+    set->hashes = (unsigned int *) malloc(sizeof(unsigned int)*set->capacity);
+    pool_init(&set->pool);
+    if(set->words == NULL || set->sizes == NULL || set->hashes == NULL){
+	word_set_free(set);
+	return 0;
+    }
+    return 1;
+}
+
+
+//// word_set_insert function
+// Given a word set, a word and its size, adds a copy of word to set unless
+// it is there already. Returns 1 if word was added, 0 if it was in set or -1
+// if memory could not be alloc'd.
+short word_set_insert(word_set * set, unsigned short * word, int size)
+{
+    unsigned short ** words = NULL;
+    int * sizes = NULL;
+    unsigned int * hashes = NULL;
+    unsigned int hash = hash_letters(word, size);
+    size_t slot = 0, i = 0, capacity = 0;
+
+    slot = hash & (set->capacity - 1);
+    while(set->words[slot] != NULL){
+	if(set->hashes[slot] == hash && set->sizes[slot] == size &&
+	   memcmp(set->words[slot], word, sizeof(short)*size) == 0)
+	    return 0;
+	slot = (slot + 1) & (set->capacity - 1);
+    }
+    if(2*(set->count + 1) > set->capacity){	// Grows and finds slot again
+	capacity = 2*set->capacity;
+	words = (unsigned short **) calloc(capacity, sizeof(unsigned short *));
+	sizes = (int *) malloc(sizeof(int)*capacity);
+	hashes = (unsigned int *) malloc(sizeof(unsigned int)*capacity);
+	if(words == NULL || sizes == NULL || hashes == NULL){
+	    free(words);
+	    free(sizes);
+	    free(hashes);
+	    return -1;
+	}
+	for(i = 0; i < set->capacity; i++){
+	    if(set->words[i] == NULL) continue;
+	    slot = set->hashes[i] & (capacity - 1);
+	    while(words[slot] != NULL) slot = (slot + 1) & (capacity - 1);
+	    words[slot] = set->words[i];
+	    sizes[slot] = set->sizes[i];
+	    hashes[slot] = set->hashes[i];
+	}
+	free(set->words);
+	free(set->sizes);
+	free(set->hashes);
+	set->words = words;
+	set->sizes = sizes;
+	set->hashes = hashes;
+	set->capacity = capacity;
+	slot = hash & (capacity - 1);
+	while(set->words[slot] != NULL) slot = (slot + 1) & (capacity - 1);
+    }
+    // +1 so that the empty word gets memory too
+    set->words[slot] = pool_alloc(&set->pool, size + 1);
+    if(set->words[slot] == NULL) return -1;
+    memcpy(set->words[slot], word, sizeof(short)*size);
+    set->sizes[slot] = size;
+    set->hashes[slot] = hash;
+    set->count++;
+    return 1;
+}
+
+
+//// word_set_free function
+// Given a word set, frees its memory
+void word_set_free(word_set * set)
+{
+    free(set->words);
+    free(set->sizes);
+    free(set->hashes);
+    pool_release(&set->pool);
+    set->words = NULL;
+    set->sizes = NULL;
+    set->hashes = NULL;
+}
+
+
+//// parse_options function
+// Given argc and argv of main and a pointer to run options, reads options
+// (arguments that are not modes or words) into opts and removes them from
+// argv. Returns the number of arguments left in argv.
+int parse_options(int argc, char * argv[], run_options * opts)
+{
+    int i = 0, new_argc = 1;
+    long value = 0;
+    char * end = NULL;
+
+    ni_default_options(&opts->context);
+    opts->memo_stats = 0;
+    opts->binary_out = 0;
+    opts->classes = 0;
+    opts->canonical = 0;
+    opts->stats = 0;
+    opts->limited = 0;
+    opts->db_path = NULL;
+    opts->db_read_only = 0;
+    for(i = 1; i < argc; i++){
+	if(!strcmp(argv[i], "--memo")){
+	    if(i + 1 >= argc) usage_message();
+	    value = strtol(argv[++i], &end, 10);
+	    if(*end != '\0' || value < 0){
+		printf("Memo budget was not recognized \r\n");
+		usage_message();
+	    }
+	    opts->context.memo_budget = (size_t) value << 20;
+	}
+	else if(!strcmp(argv[i], "--memo-stats"))
+	    opts->memo_stats = 1;
+	else if(!strcmp(argv[i], "--binary-out"))
+	    opts->binary_out = 1;
+	else if(!strcmp(argv[i], "--classes"))
+	    opts->classes = 1;
+	else if(!strcmp(argv[i], "--canonical"))
+	    opts->canonical = 1;
+	else if(!strcmp(argv[i], "--stats"))
+	    opts->stats = 1;
+	else if(!strcmp(argv[i], "--db")){
+	    if(i + 1 >= argc) usage_message();
+	    opts->db_path = argv[++i];
+	}
+	else if(!strcmp(argv[i], "--db-read-only"))
+	    opts->db_read_only = 1;
+	else if(!strcmp(argv[i], "--max-ni")){
+	    if(i + 1 >= argc) usage_message();
+	    value = strtol(argv[++i], &end, 10);
+	    if(*end != '\0' || value < 0 || value >= INT_MAX){
+		printf("Bound on nesting index was not recognized \r\n");
+		usage_message();
+	    }
+	    opts->context.bound = (int) value;
+	}
+	else if(!strcmp(argv[i], "--search-table")){
+	    if(i + 1 >= argc) usage_message();
+	    value = strtol(argv[++i], &end, 10);
+	    if(*end != '\0' || value < 0){
+		printf("Search table budget was not recognized \r\n");
+		usage_message();
+	    }
+	    opts->context.table_budget = (size_t) value << 20;
+	}
+	else if(!strcmp(argv[i], "--time-limit")){
+	    if(i + 1 >= argc) usage_message();
+	    opts->context.time_limit = strtod(argv[++i], &end);
+	    if(*end != '\0' || !(opts->context.time_limit >= 0)){
+		printf("Time limit was not recognized \r\n");
+		usage_message();
+	    }
+	    opts->limited |= (opts->context.time_limit > 0);
+	}
+	else if(!strcmp(argv[i], "--frontier-limit")){
+	    if(i + 1 >= argc) usage_message();
+	    value = strtol(argv[++i], &end, 10);
+	    if(*end != '\0' || value < 0){
+		printf("Frontier limit was not recognized \r\n");
+		usage_message();
+	    }
+	    opts->context.frontier_limit = (size_t) value;
+	    opts->limited |= (value > 0);
+	}
+	else if(!strcmp(argv[i], "--memory-limit")){
+	    if(i + 1 >= argc) usage_message();
+	    value = strtol(argv[++i], &end, 10);
+	    if(*end != '\0' || value < 0){
+		printf("Memory limit was not recognized \r\n");
+		usage_message();
+	    }
+	    opts->context.memory_limit = (size_t) value << 20;
+	    opts->limited |= (value > 0);
+	}
+	else if(!strcmp(argv[i], "--engine")){
+	    if(i + 1 >= argc) usage_message();
+	    i++;
+	    if(!strcmp(argv[i], "bfs")) opts->context.engine = ENGINE_BFS;
+	    else if(!strcmp(argv[i], "dfs")) opts->context.engine = ENGINE_DFS;
+	    else{
+		printf("Engine was not recognized \r\n");
+		usage_message();
+	    }
+	}
+	else if(!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")){
+	    if(i + 1 >= argc) usage_message();
+	    value = strtol(argv[++i], &end, 10);
+	    if(*end != '\0' || value < 1 || value > 4096){
+		printf("Number of jobs was not recognized \r\n");
+		usage_message();
+	    }
+	    opts->context.jobs = (int) value;
+	}
+	else
+	    argv[new_argc++] = argv[i];
+    }
+    argv[new_argc] = NULL;
+    return new_argc;
 }
 
 
@@ -221,7 +1521,35 @@ void usage_message(){
     printf("To get a frequency of recognized nesting indices use: \r\n\t");
     printf("./NestIndex -c Infile.txt [Outfile.txt]\r\n\r\n");
     printf("To consider the class of cyclically equivalent words use: \r\n\t");
-    printf("./NestIndex -i 123321\r\n\r\n");
+    printf("./NestIndex -i 123321 or ./NestIndex -i -t Infile.txt [Outfile.txt]\r\n\r\n");
+    printf("To get the frequency of nesting indices of all DOWs with n letters use: \r\n\t");
+    printf("./NestIndex --enumerate n [--classes]\r\n\r\n");
+    printf("To answer words sent one per line on stdin or to a Unix socket use: \r\n\t");
+    printf("./NestIndex --serve [socket]\r\n\r\n");
+    printf("Options for any of the above: \r\n\t");
+    printf("--memo MB      memory for known nesting indices (0 is off)\r\n\t");
+    printf("--memo-stats   print memo hit and miss counts to stderr\r\n\t");
+    printf("-j N           reduce words or classes (or levels of a single word)\r\n\t");
+    printf("               on N threads\r\n\t");
+    printf("--binary-out   with -t, write binary NI records\r\n\t");
+    printf("--canonical    with -t or -c, reduce one word per class of\r\n\t");
+    printf("               cyclically equivalent words\r\n\t");
+    printf("--max-ni k     stop reducing words once their NI is known to be above k\r\n\t");
+    printf("--engine E     search for NI breadth first (bfs) or depth first (dfs)\r\n\t");
+    printf("--search-table MB  memory for depths refuted by dfs\r\n\t");
+    printf("--time-limit s stop reducing a word after s seconds and report\r\n\t");
+    printf("               bounds on its NI\r\n\t");
+    printf("--frontier-limit n  same, once a level of its reduction holds\r\n\t");
+    printf("               more than n words\r\n\t");
+    printf("--memory-limit MB  same, once a level needs more than MB megabytes\r\n\t");
+    printf("--db path      keep nesting indices in a database file reused by\r\n\t");
+    printf("               later runs\r\n\t");
+    printf("--db-read-only look nesting indices up in --db without adding to it\r\n\t");
+    printf("--stats        print statistics of each word and of the run to\r\n\t");
+    printf("               stderr as JSON\r\n\r\n");
+    printf("To convert between text and binary word files use: \r\n\t");
+    printf("./NestIndex --to-binary Infile.txt Outfile.bin\r\n\t");
+    printf("./NestIndex --to-text Infile.bin Outfile.txt\r\n\r\n");
     exit(0);
 }
 
@@ -229,637 +1557,748 @@ void usage_message(){
 //// get_word function
 // Given string and a pointer to an int (size), returns representation of
 // word in string as an array of unsigned shorts and updates size with the
-// length of the returned array.
+// length of the returned array. Exits if string is not a word.
 unsigned short * get_word(char * str_arg, int * size)
 {
-    int new_size = 0, i = 0, punct_ctr = 0;
-    char * token = NULL;
     unsigned short * word = NULL;
-    short isdelimited = 0;
 	
-    for(i = 0; i < *size && !isdelimited; i++)
-	isdelimited = ispunct(str_arg[i]);
-
-    if(!isdelimited){
-	word = (unsigned short *) malloc(sizeof(unsigned short)*(*size));
-	if(word == NULL){
-	    printf("Memory could not be alloc'd for word(1)");
-	    exit(1);
-	}
-	// Converts chars to ints
-	for(i = 0; i < *size; i++)
-	    word[i] = (unsigned short) (str_arg[i] - '0');
-    }	
-    else{
-	// Counts delimiters so that correct amount of mem can be alloc'd
-	for(i = 0; i < *size; i++)
-	    if(ispunct(str_arg[i])) punct_ctr++;
-	word = (unsigned short *) calloc((punct_ctr + 1), sizeof(unsigned short));
-	if(word == NULL){
-	    printf("Memory could not be alloc'd for word(2)");
-	    exit(1);
-	}
-	// Word is written letter by letter by tokenizing each letter in str_arg
-	new_size = 0;
-	token = strtok(str_arg, ",-.!#$%&'*+/");
-	do{
-	    // Parses token, makes conversion digit by digit
-	    for(i = 0; i < strlen(token); i++){
-		word[new_size] += (unsigned short) \
-		    pow(10, (strlen(token)-i-1)) * (token[i] - '0');
-	    }
-	    new_size++;
-	    // Prepares for next letter
-	    token = strtok(NULL, ",-.!#$%&'*+/");
-	}while(token != NULL && new_size - 1 != punct_ctr);
-	*size = new_size;
+    // +1 so that the empty word gets memory too
+    word = (unsigned short *) malloc(sizeof(unsigned short)*(*size + 1));
+    if(word == NULL){
+	printf("Memory could not be alloc'd for word(1)");
+	exit(1);
+    }
+    *size = ni_parse_word(str_arg, *size, word);
+    if(*size < 0){
+	printf("Argument for word was not recognized \r\n");
+	usage_message();
     }
     return word;
 }
 
+//// reader_open function
+// Given a word reader and the name of an input file ("-" for stdin), opens
+// file for reader_next. Returns 0 if file could not be opened, else 1.
+short reader_open(word_reader * reader, const char * name)
+{
+    struct stat info;
+    int fd = -1;
 
+    reader->file = NULL;
+    reader->data = NULL;
+    reader->length = reader->pos = reader->capacity = 0;
+    reader->at_eof = 0;
+    reader->started = 0;
 
-//// step function - performs one reduction step
-// Given a DOW word, its size, and two pointers to ints (count and sizes),
-// returns an array of words obtained from either operation 1: removing maximal
-// subwords from word and or from operation 2: removing a of letter of word not
-// contained in a maximal subword. Recall from http://arxiv.org/abs/1311.3543
-// that a maximal subword is repeat word or return word that contains no other
-// repeat word or return word as a subword. Function updates count with number
-// of words in returned array and sizes with the size of each of the those words.
-unsigned short ** step(unsigned short * word, int size, int * count, int * sizes)
-{
-    unsigned short ** reduction_list = NULL, ** return_list = NULL;
-    unsigned short * letters = NULL;
-    unsigned short drop_list[size/2];
-    int seq_count = 0, drop_ctr = 0, i = 0, n = 0;
-    int new_size = 0;	// Variable gets size of first word in return_list
-    // Only important size since rest will be size - 2
-	
-    letters = get_letters(word, size);
-    *count = 0;  // Number of words returned
-
-    // If size <= 4, step results in empty word, regardless of DOW given
-    if(size <= 4){
-	free(letters);
-	return NULL;
-    }
-    reduction_list = get_repeat_return_words(word, size, &seq_count);
-
-    // Creates list of letters, not in repeat/return word, to be dropped
-    if(reduction_list != NULL){	
-	// Checks if letters are in repeat/return word
-	for(i = 0; i < size/2; i++){		
-	    if(!is_in_seq(letters[i], reduction_list, seq_count))
-		drop_list[drop_ctr++] = letters[i];
-	}
-	*count = drop_ctr + 1; // +1 for word - reduction_list
-    }
-    else{ // Every letter in word goes to drop list
-	for(i = 0; i < size/2; i++)
-	    drop_list[i] = letters[i];
-	*count = size/2;	// count = # of distinct letters in word
-    }
-    free(letters);
-
-    // Allocates mem for return_list
-    return_list = (unsigned short **) \
-	malloc(sizeof(unsigned short *)*(*count));
-    if(return_list == NULL) {
-	for(i = 0; i < seq_count; i++) free(reduction_list[i]);
-	free(reduction_list);
-	free(word);
-	printf("Memory could not be alloc'd for return_list");
-	exit(1);
-    }
-    // Return list gets word with seqs removed in first position
-    if(reduction_list != NULL){
-	return_list[0] = remove_seqs(word, size, reduction_list,
-				     seq_count, &new_size);
-	return_list[0] = relabel(return_list[0], new_size);
-	if(new_size == 0){
-	    // Frees allocated memory
-	    free(return_list[0]);
-	    free(return_list);
-	    for(i = 0; i < seq_count; i++) free(reduction_list[i]);
-	    free(reduction_list);
-	    return NULL;
-	}
-	sizes[0] = new_size;
-
-	// Frees memory allocated for seqs
-	for(i = 0; i < seq_count; i++)
-	    free(reduction_list[i]);
-	free(reduction_list);
-    }
-    // This gets words with letter from drop_list removed
-    n = 0;
-    for(i = (reduction_list == NULL)? 0: 1; i < *count; i++){
-	return_list[i] = remove_ltr(word, size, drop_list[n++]);
-	return_list[i] = relabel(return_list[i], size - 2);
-	sizes[i] = size - 2;
-    }
-    return return_list;
-}
-
-//// get_NI function
-// Given a word and its size, returns nesting index of word
-int get_NI(unsigned short * word, int size)
-{
-    unsigned short ** current_words = NULL, ** next_words = NULL,
-	** step_words = NULL;
-    int * step_sizes = NULL, * next_sizes = NULL, * current_sizes = NULL;
-    int sizes_sum = 0;
-    int step_count = 0, current_count = 0, next_count = 0;
-    int i = 0, j = 0, NI = 0;
-		
-    // Checks if word is double occurrence
-    if(!is_double_occurrence(word, size)) return -1;
-
-    // Handles case if word is empty word
-    NI = 0;
-    if(size == 0) return NI;
-	
-    step_sizes = (int *) malloc(sizeof(int)*(size/2));
-    if(step_sizes == NULL) {
-	free(word);
-	printf("Memory could not be alloc'd for step_sizes");
-	exit(1);
+    if(strcmp(name, "-") != 0){
+	// Regular files are mapped
+	fd = open(name, O_RDONLY);
+	if(fd == -1) return 0;
+	if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+	    reader->data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE,
+				fd, 0);
+	    if(reader->data != MAP_FAILED){
+		madvise(reader->data, info.st_size, MADV_SEQUENTIAL);
+		reader->length = info.st_size;
+		reader->at_eof = 1;
+		close(fd);
+		reader_detect_format(reader);
+		return 1;
+	    }
+	    reader->data = NULL;
+	}
+	reader->file = fdopen(fd, "r");
+	if(reader->file == NULL){
+	    close(fd);
+	    return 0;
+	}
     }
-    current_count = 0;
-    step_words = step(word, size, &current_count, step_sizes);
-    NI++;
-    if(step_words == NULL){	// First step gives empty word
-	free(step_sizes);
-	return NI;
-    }
-    current_words = (unsigned short **) malloc(sizeof(unsigned short *)*(current_count));
-    current_sizes = (int *) malloc(sizeof(int)*(current_count));
-    if(current_sizes == NULL || current_words == NULL){
-	free(step_sizes);
-	free(word);
-	if(current_sizes != NULL) free(current_sizes);
-	if(current_words != NULL) free(current_words);
-	printf("Memory could not be alloc'd for current_sizes/current_words");
-	exit(1);
+    else reader->file = stdin;
+    // Other input is read into buffer in chunks
+    reader->data = (char *) malloc(READER_CHUNK);
+    if(reader->data == NULL){
+	reader_close(reader);
+	return 0;
     }
-    copy_words(current_words, current_sizes, step_words, step_sizes,
-	       &current_count);
-    free(step_words);
-    step_words = NULL;
+    reader->capacity = READER_CHUNK;
+    reader_detect_format(reader);
+    return 1;
+}
 
-    // Runs while there is no empty empty word
-    while(1){
-	NI++;
-	// Gets upper bound on # of branch points from current words for memory
-	// allocation
-	sizes_sum = 0;
-	for(i = 0; i < current_count; i++)
-	    sizes_sum += current_sizes[i];
-	sizes_sum /= 2;
-	next_words = malloc(sizeof(unsigned short *)*sizes_sum);
-	next_sizes = malloc(sizeof(int)*sizes_sum);
-	if(next_sizes == NULL || next_words == NULL){
-	    free(step_sizes);
-	    free(step_words);
-	    for(i = 0; i < current_count; i++) free(current_words[i]);
-	    free(current_words);
-	    if(next_sizes != NULL) free(next_sizes);
-	    if(next_words != NULL) free(next_words);
-	    free(word);
-	    printf("Memory could not be alloc'd for next_sizes/next_words");
-	    exit(1);
-	}
-	next_count = 0;
-	for(i = 0; i < current_count; i++){ // Iterates over words in current_words
-	    step_count = 0;
-	    step_words = step(current_words[i], current_sizes[i], &step_count,
-	                      step_sizes);
-	    if(step_words == NULL){
-		for(j = 0; j < current_count; j++) free(current_words[j]);
-		free(current_words);
-		free(current_sizes);
-		for(j = 0; j < next_count; j++) free(next_words[j]);
-		free(next_words);
-		free(next_sizes);
-		free(step_sizes);
-		return NI;
-	    }
-			
-	    memcpy((next_words + next_count), step_words, 
-		   sizeof(unsigned short *)*(step_count));
-	    memcpy((next_sizes + next_count), step_sizes,
-		   sizeof(int)*(step_count));
-	    next_count += step_count;
-
-	    // Contents of step_words not freed because contents (addresses)
-	    // were just copied to next_words hence, freeing them would cause
-	    // TROUBLE!!
-	    free(step_words);
-	    step_words = NULL;
-	}
-	for(i = 0; i < current_count; i++) free(current_words[i]);
-	free(current_words);
-	current_words = NULL;
-	free(current_sizes);
-	current_sizes = NULL;
-
-	// Step complete
-	// Current words become next_words
-	current_words = (unsigned short **) \
-	    malloc(sizeof(unsigned short *)*(next_count));
-	current_sizes = (int *) malloc(sizeof(int)*(next_count));
-	if(current_words == NULL || current_sizes == NULL){
-	    free(step_words);
-	    free(step_sizes);
-	    free(next_sizes);
-	    for(i = 0; i < next_count; i++) free(next_words[i]);
-	    if(current_words != NULL) free(current_words);
-	    if(current_sizes != NULL) free(current_sizes);
-	    free(word);
-	    printf("Memory could not be alloc'd for current_words/current_sizes");
+//// reader_detect_format function
+// Given a newly opened word reader, sets its format from the first bytes of
+// input, skipping the magic of binary formats.
+void reader_detect_format(word_reader * reader)
+{
+    reader->format = FORMAT_TEXT;
+    if(!reader_ensure(reader, BINARY_MAGIC_SIZE)) return;
+    if(!memcmp(reader->data + reader->pos, BINARY_DOW_MAGIC, BINARY_MAGIC_SIZE))
+	reader->format = FORMAT_BINARY_DOW;
+    else if(!memcmp(reader->data + reader->pos, BINARY_NI_MAGIC,
+		    BINARY_MAGIC_SIZE))
+	reader->format = FORMAT_BINARY_NI;
+    if(reader->format != FORMAT_TEXT) reader->pos += BINARY_MAGIC_SIZE;
+}
+
+//// reader_fill function
+// Given a word reader reading in chunks, moves bytes not yet read to the
+// front of its buffer, doubling the buffer if they fill it, and reads more
+// bytes after them. Returns 0 if no more bytes could be read, else 1.
+short reader_fill(word_reader * reader)
+{
+    char * data = NULL;
+    size_t bytes = 0;
+
+    if(reader->at_eof) return 0;
+    memmove(reader->data, reader->data + reader->pos,
+	    reader->length - reader->pos);
+    reader->length -= reader->pos;
+    reader->pos = 0;
+    if(reader->length == reader->capacity){
+	data = (char *) realloc(reader->data, 2*reader->capacity);
+	if(data == NULL){
+	    printf("Memory could not be alloc'd for input buffer");
 	    exit(1);
 	}
-	copy_words(current_words, current_sizes, next_words, next_sizes,
-	           &next_count);
-	current_count = next_count;
-	free(next_words);
-	free(next_sizes);
+	reader->data = data;
+	reader->capacity *= 2;
     }
+    bytes = fread(reader->data + reader->length, 1,
+		  reader->capacity - reader->length, reader->file);
+    reader->length += bytes;
+    if(bytes == 0) reader->at_eof = 1;
+    return (bytes != 0);
 }
 
-//// copy_words function
-// Copies words from source to destination without copying duplicates
-void copy_words(unsigned short ** dest, int * dest_sizes,
-		unsigned short ** source, int * source_sizes, int * count)
+//// reader_next function
+// Given a word reader and pointers to a string and an int, points word to
+// next white-space delimited word of input and updates size with its number
+// of chars. Anything before the first digit of input is skipped. Word stays
+// valid until the next call. Returns 0 at end of input, else 1.
+short reader_next(word_reader * reader, const char ** word, int * size)
 {
-    int i = 0, j = 0, ctr = 0;
-    short isInDest = 0;
-	
-    for(i = 0; i < *count; i++){
-	isInDest = 0;
-	for(j = 0; j < ctr && !(isInDest); j++){
-	    if(source_sizes[i] == dest_sizes[j]){	// Could be a match
-		isInDest = \
-		    (memcmp(source[i], dest[j], sizeof(short)*(dest_sizes[j])) == 0);
-	    }
-	}
-	if(!isInDest){	// Add seq to dest
-	    j *= 2;
-	    memcpy((dest + ctr), (source + i), sizeof(short *));
-	    dest_sizes[ctr] = source_sizes[i];
-	    ctr++;
-	}
-	else free(source[i]);
+    size_t end = 0, offset = 0;
+    short filled = 0;
+
+    // Skips to start of word (first digit if nothing read yet)
+    while(1){
+	while(reader->pos < reader->length &&
+	      (reader->started?
+	       isspace((unsigned char) reader->data[reader->pos]):
+	       !isdigit((unsigned char) reader->data[reader->pos])))
+	    reader->pos++;
+	if(reader->pos < reader->length) break;
+	if(!reader_fill(reader)) return 0;
+    }
+    reader->started = 1;
+
+    // Finds end of word, reading more input if word reaches end of buffer
+    end = reader->pos;
+    while(1){
+	while(end < reader->length && !isspace((unsigned char) reader->data[end]))
+	    end++;
+	if(end < reader->length || reader->at_eof) break;
+	offset = end - reader->pos;
+	filled = reader_fill(reader);
+	end = reader->pos + offset;
+	if(!filled) break;
     }
-    *count = ctr;
+    *word = reader->data + reader->pos;
+    *size = (int) (end - reader->pos);
+    reader->pos = end;
+    return 1;
 }
 
+//// reader_ensure function
+// Given a word reader and a number of bytes, reads input until that many
+// bytes not yet read are in data. Returns 0 if input ends first, else 1.
+short reader_ensure(word_reader * reader, size_t bytes)
+{
+    while(reader->length - reader->pos < bytes && reader_fill(reader));
+    return (reader->length - reader->pos >= bytes);
+}
 
-//// get_letters function
-// Given DOW and its size, returns an array of the letters (which are ints)
-// in that word.
-unsigned short * get_letters(unsigned short * word, int size)
+//// read_word function
+// Given a word reader, a pool and pointers to a word and an int, reads the
+// next word of input into room alloc'd from pool, pointing word to it and
+// updating size with its size. Returns 1 if a word was read, 0 at end of
+// input or -1 if input is cut off within a word. Text that is not a word is
+// skipped.
+short read_word(word_reader * reader, word_pool * pool,
+		unsigned short ** word, int * size)
 {
-    unsigned short * letters = calloc(size, sizeof(unsigned short));
-    short notInAlphabet = 0;
-    short letter_ctr = 0;
-    int i = 0, j =0;
-	
-    if(letters == NULL){
-	free(word);
-	printf("mem could not be alloc'd for letters");
+    const char * token = NULL;
+    const unsigned char * bytes = NULL;
+    unsigned int header = 0;
+    int token_size = 0, i = 0;
+
+    if(reader->format == FORMAT_TEXT){
+	// Skips tokens that are not words
+	do{
+	    if(!reader_next(reader, &token, &token_size)) return 0;
+	    // A word has at most as many letters as chars
+	    *word = pool_alloc(pool, token_size);
+	    if(*word == NULL){
+		printf("Memory could not be alloc'd for word");
+		exit(1);
+	    }
+	    *size = ni_parse_word(token, token_size, *word);
+	} while(*size < 0);
+	return 1;
+    }
+
+    // Binary DOW record
+    if(!reader_ensure(reader, 4))
+	return (reader->pos == reader->length)? 0: -1;
+    bytes = (const unsigned char *) reader->data + reader->pos;
+    header = bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+	(unsigned int) bytes[3] << 24;
+    *size = (int) (header >> 1);
+    if(!reader_ensure(reader, 4 + ((header & 1)? 2: 1)*(size_t) *size))
+	return -1;
+    bytes = (const unsigned char *) reader->data + reader->pos + 4;
+    *word = pool_alloc(pool, *size);
+    if(*word == NULL){
+	printf("Memory could not be alloc'd for word");
 	exit(1);
     }
-    for(i = 0; i < size; i++){
-	notInAlphabet = 1;
-	for(j = 0; j < letter_ctr; j++){
-	    if(word[i] == letters[j]) notInAlphabet = 0;
-	}
-	if(notInAlphabet)
-	    letters[letter_ctr++] = word[i];
+    if(header & 1){
+	for(i = 0; i < *size; i++)
+	    (*word)[i] = bytes[2*i] | bytes[2*i + 1] << 8;
+    }
+    else{
+	for(i = 0; i < *size; i++)
+	    (*word)[i] = bytes[i];
     }
-    return letters;
+    reader->pos += 4 + ((header & 1)? 2: 1)*(size_t) *size;
+    return 1;
 }
 
-//// occurrences function
-// Given a word w, its size and a letter (int) in w, returns indices of each
-// occurence of that letter in w.
-int * occurrences(unsigned short * w, int size, unsigned short letter)
+//// read_class_word function
+// Same as read_word, but if classes is not NULL each word is replaced by the
+// canonical word of its class and words whose class is in classes are
+// skipped. Words that are not DOWs are kept as they are.
+short read_class_word(word_reader * reader, word_pool * pool,
+		      word_set * classes, unsigned short ** word, int * size)
 {
-    int * occs = (int *) malloc(sizeof(int)*2);
-    int n = 0, i = 0;
-	
-    for(i = 0; i < size; i++){
-	if(w[i] == letter){
-	    occs[n++] = i;
-	}			
+    short status = 0, is_new = 0;
+
+    do{
+	status = read_word(reader, pool, word, size);
+	if(status <= 0 || classes == NULL) return status;
+	if(ni_canonical(*word, *size, *word) < 1) return status;
+	is_new = word_set_insert(classes, *word, *size);
+	if(is_new < 0){
+	    printf("Memory could not be alloc'd for classes");
+	    exit(1);
+	}
+    } while(!is_new);
+    return status;
+}
+
+//// reader_close function
+// Given a word reader, unmaps or closes its input file and frees its buffer
+void reader_close(word_reader * reader)
+{
+    if(reader->capacity == 0){
+	if(reader->data != NULL) munmap(reader->data, reader->length);
+    }
+    else{
+	free(reader->data);
+	if(reader->file != NULL && reader->file != stdin) fclose(reader->file);
     }
-    return occs;
+    reader->data = NULL;
+    reader->file = NULL;
 }
 
-//// is_double_occurrence function
-// Given a word w and its size, returns 1 if w is double occurrence, else 0
-short is_double_occurrence(unsigned short * word, int size)
+
+//// write_binary_word function
+// Given a file and a word with its size, writes word as a binary DOW record
+void write_binary_word(FILE * file, unsigned short * word, int size)
 {
-    int i = 0, j = 0;
-    short ltr_ctr = 0;
-    unsigned short * letters;
-	
-    letters = get_letters(word, size);
-    for(i = 0; i < size/2; i++){	// Iterates over ltr in letters
-	ltr_ctr = 0;
-	// Iterates over short in word and gets count of ltr in word
-	for(j = 0; j < size; j++){
-	    if (letters[i] == word[j]) ltr_ctr++;
-	}
-	if(ltr_ctr != 2){
-	    free(letters);
-	    return 0;
+    unsigned char record[4 + 2*size];
+    unsigned int header = 0;
+    int i = 0, wide = 0;
+
+    for(i = 0; i < size && !wide; i++) wide = (word[i] > 255);
+    header = (unsigned int) size << 1 | wide;
+    for(i = 0; i < 4; i++) record[i] = (unsigned char) (header >> 8*i);
+    for(i = 0; i < size; i++){
+	if(wide){
+	    record[4 + 2*i] = (unsigned char) word[i];
+	    record[5 + 2*i] = (unsigned char) (word[i] >> 8);
 	}
+	else record[4 + i] = (unsigned char) word[i];
     }
-    free(letters);
-    return 1;
+    fwrite(record, 1, 4 + (wide? 2: 1)*size, file);
 }
 
+//// write_binary_NI function
+// Given a file, the index of a word in input and its nesting index, writes
+// them as a binary NI record
+void write_binary_NI(FILE * file, unsigned long long word_id, int NI)
+{
+    unsigned char record[BINARY_NI_RECORD];
+    int i = 0;
+
+    for(i = 0; i < 8; i++) record[i] = (unsigned char) (word_id >> 8*i);
+    for(i = 0; i < 4; i++)
+	record[8 + i] = (unsigned char) ((unsigned int) NI >> 8*i);
+    fwrite(record, 1, BINARY_NI_RECORD, file);
+}
 
-//// get_repeat_return_words function
-// Given a DOW w, its size and a pointer to an int len,returns maximal subwords
-// of w using sequences(w) and updates len with the number of maximal subwords
-// found.
-unsigned short ** get_repeat_return_words(unsigned short * w, int size, int * len)
+//// convert_corpus function
+// Given names of an input and an output file ("-" for stdin or stdout) and
+// to_binary, converts a text file of words to a binary DOW file if to_binary
+// is true, else a binary DOW or NI file to text. Text words are written
+// with commas if they have 20 or more letters or a letter above 9, so that
+// they read back the same. Returns exit status for main.
+int convert_corpus(const char * in_name, const char * out_name,
+		   short to_binary)
 {
-    unsigned short ** subwords = (unsigned short **) \
-	malloc(sizeof(unsigned short *)*(size/2));
-    short diff[size - 1];
-    int i = 0, count = 0;
-    short state = 0, place = 0;
-	
-    if(subwords == NULL){
-	free(w);
-	printf("Memory could not be alloc'd for subwords");
-	exit(1);
+    word_reader reader;
+    word_pool pool;
+    unsigned short * word = NULL;
+    const unsigned char * bytes = NULL;
+    unsigned long long word_id = 0;
+    unsigned int NI = 0;
+    FILE * out = NULL;
+    int size = 0, i = 0;
+    short status = 0, commas = 0;
+
+    if(!reader_open(&reader, in_name)){
+	printf("Couldn't open file: %s \r\n", in_name);
+	return 1;
     }
-    *len = 0;
-	
-    // Algorithm uses diff = w[i+1] - w[i] for i in 0:size.
-    // Note that if diff == [1 1 ... 1 0 -1 ... -1 -1] word is return word
-    // and if diff == [1 1 ... 1 -n 1 ... 1 1] word is repeat word
-    for(i = 0; i < size - 1; i++){
-	diff[i] = (w[i+1] - w[i]);
+    if(to_binary == (reader.format != FORMAT_TEXT)){
+	printf("File is already %s: %s \r\n", to_binary? "binary": "text",
+	       in_name);
+	reader_close(&reader);
+	return 1;
     }
-	
-    // Checks for return words
-    state = 0;
-    place = 0;
-    count = 0;
-    for(i = 0; i < size - 1; i++){
-	switch(diff[i]) {
-	case 0:    // Expecting -1
-	    if(state == 1 && i != size - 2) state = 2;
-	    else{	// Must be a loop
-		// Allocate space for loop
-		subwords[*len] = (unsigned short *) malloc(sizeof(short)*2);
-		if(subwords[*len] == NULL){	
-		    for(i = 0; i < *len; i++) free(subwords[i]);
-		    free(subwords);
-		    free(w);
-		    printf("Memory could not be alloc'd for loop");
-		    exit(1);
-		}
-		memcpy(subwords[*len], (w + i), sizeof(short)*2);
-		*len += 1;
-		state = 0;
-		count = 0;
-	    }
-	    break;
-	case 1:
-	    if(state == 0) place = i;  // Holds placement of first 1
-	    else if(state == 2){
-		place += count;
-		subwords[*len] = (unsigned short *) malloc(sizeof(short)*((i - place)+ 1));
-		if(subwords[*len] == NULL){
-		    for(i = 0; i < *len; i++) free(subwords[i]);
-		    free(subwords);
-		    free(w);
-		    printf("Memory could not be alloc'd for return word (1)");
-		    exit(1);
-		}
-		memcpy(subwords[*len], (w + place), sizeof(short)*((i - place) + 1));
-		*len += 1;
-		place = i;
-		count = 0;
-	    }					
-	    state = 1;	// Expecting 0
-	    count++;
-	    break;
-	case -1:
-	    if(state == 2){
-		count--;
-		if(count == 0 || (i == size - 2)){	// Return word found
-		    if(i == size - 2)	place += count;
-		    subwords[*len] = (unsigned short *) \
-			malloc(sizeof(short)*((i - place) + 2));
-		    if(subwords[*len] == NULL){	
-			for(i = 0; i < *len; i++) free(subwords[i]);
-			free(subwords);
-			free(w);
-			printf("Memory could not be alloc'd for return word (2)");
-			exit(1);
-		    }
-		    memcpy(subwords[*len], (w + place), \
-			   sizeof(short)*((i - place) + 2));
-		    *len += 1;
-		    state = 0;
-		    count = 0;
-		}
-	    }
-	    else{
-		state = 0;
-		count = 0;
-	    }
-	    break;
-	default:
-	    if(state == 2){	// Return word found
-		place += count;
-		subwords[*len] = (unsigned short *) \
-		    malloc(sizeof(short)*((i - place) + 1));
-		if(subwords[*len] == NULL){	
-		    for(i = 0; i < *len; i++) free(subwords[i]);
-		    free(subwords);
-		    free(w);
-		    printf("Memory could not be alloc'd for return word (3)");
-		    exit(1);
-		}
-		memcpy(subwords[*len], (w + place), \
-		       sizeof(short)*((i - place) + 1));
-		*len += 1;
-	    }		
-	    state = 0;
-	    count = 0;
+    out = strcmp(out_name, "-")? fopen(out_name, "wb"): stdout;
+    if(out == NULL){
+	printf("Couldn't open file: %s \r\n", out_name);
+	reader_close(&reader);
+	return 1;
+    }
+    if(to_binary) fwrite(BINARY_DOW_MAGIC, 1, BINARY_MAGIC_SIZE, out);
+
+    if(reader.format == FORMAT_BINARY_NI){
+	while(reader_ensure(&reader, BINARY_NI_RECORD)){
+	    bytes = (const unsigned char *) reader.data + reader.pos;
+	    word_id = 0;
+	    NI = 0;
+	    for(i = 7; i >= 0; i--) word_id = word_id << 8 | bytes[i];
+	    for(i = 3; i >= 0; i--) NI = NI << 8 | bytes[8 + i];
+	    fprintf(out, "%llu: %d\r\n", word_id, (int) NI);
+	    reader.pos += BINARY_NI_RECORD;
 	}
+	status = (reader.pos != reader.length);
     }
-	
-    // Checks for repeat words
-    state = 0;
-    place = 0;
-    count = 0;
-    for(i = 0; i < size - 1; i++){
-	switch(diff[i]) {
-	case 1:
-	    if(state == 0){
-		state = 1;
-		place = i;
-		count++;
-	    }
-	    else if(state == 1){
-		count++;
-	    }
-	    else if(state == 2){
-		count--;
-		if(count == 0){	// Repeat word found
-		    subwords[*len] = (unsigned short *) \
-			malloc(sizeof(short)*((i - place) + 2));
-		    if(subwords[*len] == NULL){
-			for(i = 0; i < *len; i++) free(subwords[i]);
-			free(subwords);
-			free(w);
-			printf("Memory could not be alloc'd for return word");
-			exit(1);
-		    }
-		    memcpy(subwords[*len], (w + place), \
-			   sizeof(short)*((i - place) + 2));
-		    *len += 1;
-		    state = 0;
-		    count = 0;					
-		}
-	    }
-	    break;
-	default:
-	    if(state == 1){
-		if(diff[i] < 0 && (-1)*count <= diff[i]){
-		    place += (count + diff[i]);
-		    count = (-1)*diff[i];	// Number of 1s expected
-		    state = 2;
-		}
-		else{
-		    state = 0;
-		    count = 0;
-		}
-	    }
+    else{
+	pool_init(&pool);
+	while((status = read_word(&reader, &pool, &word, &size)) > 0){
+	    if(to_binary) write_binary_word(out, word, size);
 	    else{
-		state = 0;
-		count = 0;
+		commas = (size >= 20);
+		for(i = 0; i < size && !commas; i++) commas = (word[i] > 9);
+		for(i = 0; i < size; i++)
+		    fprintf(out, (commas && i < size - 1)? "%u,": "%u", word[i]);
+		fprintf(out, "\r\n");
 	    }
+	    pool_reset(&pool);
 	}
+	pool_release(&pool);
+	status = (status < 0);
     }
-    if(*len == 0){
-	free(subwords);
-	return NULL;
-    }
-    return subwords;
+    if(status) printf("Input ended in the middle of a record: %s \r\n", in_name);
+    reader_close(&reader);
+    if(out != stdout) fclose(out);
+    return status;
 }
 
 
-//// remove_sequences function
-// Given assembly word w and a set of a subwords of w returns w - subwords,
-// i.e., word obtained from w after removing subwords
-unsigned short * remove_seqs(unsigned short * word, int size, 
-			     unsigned short ** seqs, int seq_count, int * new_size)
+// Set by SIGINT and SIGTERM to stop run_server
+static volatile sig_atomic_t server_stop = 0;
+
+//// server_signal function
+// Given a signal, asks run_server to stop.
+void server_signal(int signal_number)
 {
-    unsigned short * new_word = (unsigned short *) \
-	malloc(sizeof(unsigned short)*(size));
-    int i = 0;
-	
-    if(new_word == NULL){
-	free(word);
-	printf("Memory could not be alloc'd for new_word (remove_seqs)");
+    (void) signal_number;
+    server_stop = 1;
+}
+
+//// run_server function
+// Given the path of a Unix socket (NULL for stdin and stdout), a context and
+// run options, answers requests (see server types) until stdin ends, or
+// until SIGINT or SIGTERM. With opts->stats, the statistics of each word
+// are printed to stderr. Returns 0, or 1 if socket could not be opened.
+int run_server(const char * path, ni_context * context, run_options * opts)
+{
+    server_client clients[SERVER_MAX_CLIENTS];
+    struct pollfd polls[SERVER_MAX_CLIENTS + 1];
+    int polled[SERVER_MAX_CLIENTS + 1];	// Client of each poll, -1 listener
+    server_request * requests = NULL;
+    unsigned short ** words = NULL;
+    int * sizes = NULL, * NIs = NULL;
+    ni_stats * stats = NULL;
+    word_pool pool;
+    struct sigaction action;
+    unsigned long long word_id = 0;
+    int listener = -1, count = 0, poll_count = 0, request_count = 0;
+    int word_count = 0, i = 0, fd = -1;
+    short waiting = 0;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = server_signal;	// No SA_RESTART, so poll returns
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);	// Failed writes drop the client instead
+    if(path != NULL && (listener = server_listen(path)) == -1){
+	printf("Couldn't open socket: %s \r\n", path);
+	return 1;
+    }
+    pool_init(&pool);
+    requests = (server_request *) malloc(sizeof(server_request)*BATCH_WORDS);
+    words = (unsigned short **) malloc(sizeof(unsigned short *)*BATCH_WORDS);
+    sizes = (int *) malloc(sizeof(int)*BATCH_WORDS);
+    NIs = (int *) malloc(sizeof(int)*BATCH_WORDS);
+    if(opts->stats) stats = (ni_stats *) malloc(sizeof(ni_stats)*BATCH_WORDS);
+    if(requests == NULL || words == NULL || sizes == NULL || NIs == NULL ||
+       (opts->stats && stats == NULL) ||
+       (path == NULL && !server_add_client(clients, &count, 0, stdout))){
+	printf("Memory could not be alloc'd for server");
 	exit(1);
     }
-    *new_size = 0;
 
-    for(i = 0; i < size; i++){
-	if(!is_in_seq(word[i], seqs, seq_count)){
-	    new_word[*new_size] = word[i];
-	    *new_size += 1;
+    while(!server_stop && (listener != -1 || count > 0)){
+	// Lines left over from a full batch are answered without waiting
+	poll_count = 0;
+	waiting = 0;
+	if(listener != -1){
+	    polls[poll_count].fd = listener;
+	    polls[poll_count].events = POLLIN;
+	    polled[poll_count++] = -1;
+	}
+	for(i = 0; i < count; i++){
+	    if(server_next_line(&clients[i], NULL, NULL)) waiting = 1;
+	    // Clients far ahead of their responses are not read from
+	    if(clients[i].ended ||
+	       clients[i].used - clients[i].start >= SERVER_MAX_LINE)
+		continue;
+	    polls[poll_count].fd = clients[i].fd;
+	    polls[poll_count].events = POLLIN;
+	    polled[poll_count++] = i;
+	}
+	if(poll(polls, poll_count, waiting? 0: -1) < 0){
+	    if(errno == EINTR) continue;
+	    break;
+	}
+	// Clients are read before new ones are added, so polled stays valid
+	for(i = 0; i < poll_count; i++){
+	    if(polled[i] == -1 || polls[i].revents == 0) continue;
+	    if(!server_read(&clients[polled[i]])) clients[polled[i]].ended = 1;
 	}
+	if(listener != -1 && (polls[0].revents & POLLIN)){
+	    fd = accept(listener, NULL, NULL);
+	    if(fd != -1 && !server_add_client(clients, &count, fd, NULL))
+		close(fd);
+	}
+
+	request_count = server_take_requests(clients, count, requests, &pool,
+					     words, sizes);
+	word_count = 0;
+	for(i = 0; i < request_count; i++)
+	    if(requests[i].word != -1) word_count++;
+	ni_compute_batch(context, (const unsigned short * const *) words,
+			 sizes, word_count, NIs, stats);
+	server_respond(clients, count, requests, request_count, NIs,
+		       opts->context.bound);
+	for(i = 0; opts->stats && i < word_count; i++)
+	    print_stats(stderr, word_id++, sizes[i], NIs[i], &stats[i]);
+	pool_reset(&pool);
+	// Drops clients that are answered and have ended, or sent a line too
+	// long to be a request
+	for(i = count - 1; i >= 0; i--){
+	    if(!server_next_line(&clients[i], NULL, NULL) &&
+	       clients[i].used - clients[i].start >= SERVER_MAX_LINE)
+		fprintf(clients[i].out, "line too long\r\n");
+	    else if(!clients[i].ended || clients[i].start < clients[i].used)
+		continue;
+	    server_drop_client(clients, &count, i);
+	}
+    }
+    while(count > 0) server_drop_client(clients, &count, count - 1);
+    if(listener != -1){
+	close(listener);
+	unlink(path);
     }
-    return new_word;
+    pool_release(&pool);
+    free(requests);
+    free(words);
+    free(sizes);
+    free(NIs);
+    free(stats);
+    return 0;
 }
 
-//// is_in_seq function
-// Given a letter and an array of words (seqs), with the number of subwords,
-// returns 1 if letter appears in one of the subwords, else 1
-short is_in_seq(short letter, unsigned short ** seqs, int seq_count)
+//// server_listen function
+// Given a path, returns a Unix socket listening at path, or -1 if it could
+// not be made. A socket left at path by an earlier server is replaced.
+int server_listen(const char * path)
 {
-    unsigned short * seq;
-    int i, j;
+    struct sockaddr_un address;
+    struct stat info;
+    int fd = -1;
 
-    for(i = 0; i < seq_count; i++){
-	seq = seqs[i];
-	j = 0;
-	do{
-	    if(letter == seq[j++]) return 1;
-	} while(seq[j] > seq[j-1]);
+    if(strlen(path) >= sizeof(address.sun_path)) return -1;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    if(stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1) return -1;
+    if(bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+       listen(fd, SOMAXCONN) != 0){
+	close(fd);
+	return -1;
     }
-    return 0;
+    return fd;
 }
 
-
-//// remove_ltr function
-// Given a DOW w, its size and a letter, returns word obtained from w after
-// removing letter
-unsigned short * remove_ltr(unsigned short * word, int size, unsigned short letter)
+//// server_add_client function
+// Given an array of clients, a pointer to their count, a descriptor and the
+// file responses go to (NULL to write them to fd), adds a client reading
+// fd. Returns 0 if there are SERVER_MAX_CLIENTS clients already or memory
+// could not be alloc'd, else 1.
+short server_add_client(server_client * clients, int * count, int fd,
+			FILE * out)
 {
-    unsigned short * new_word = (unsigned short *) \
-	malloc(sizeof(unsigned short)*(size - 2));	// -2 for removed letter
-    int i = 0, new_size = 0;
-	
-    if(new_word == NULL){
-	free(word);
-	printf("Memory could not be alloc'd for new_word (remove_ltr)");	
-	exit(1);
+    server_client * client = &clients[*count];
+
+    if(*count == SERVER_MAX_CLIENTS) return 0;
+    client->buffer = (char *) malloc(SERVER_CHUNK);
+    if(client->buffer == NULL) return 0;
+    client->out = (out != NULL)? out: fdopen(fd, "w");
+    if(client->out == NULL){
+	free(client->buffer);
+	return 0;
     }
-    i=0;
-    while (word[i] != letter){
-	new_word[new_size++] = word[i++];
+    client->fd = fd;
+    client->ended = 0;
+    client->start = client->used = 0;
+    client->capacity = SERVER_CHUNK;
+    client->received = 0;
+    // Responses of a batch are flushed at once
+    setvbuf(client->out, NULL, _IOFBF, SERVER_CHUNK);
+    (*count)++;
+    return 1;
+}
+
+//// server_drop_client function
+// Given an array of clients, a pointer to their count and the index of a
+// client, flushes and closes it and removes it from clients.
+void server_drop_client(server_client * clients, int * count, int index)
+{
+    server_client * client = &clients[index];
+
+    if(client->out == stdout) fflush(stdout);
+    else fclose(client->out);	// Also closes socket
+    free(client->buffer);
+    clients[index] = clients[--(*count)];
+}
+
+//// server_read function
+// Given a client whose descriptor is ready, reads the bytes it has sent.
+// Returns 0 if its input has ended or failed, else 1.
+short server_read(server_client * client)
+{
+    char * grown = NULL;
+    ssize_t got = 0;
+
+    // Answered bytes were moved out by server_respond
+    if(client->capacity - client->used < SERVER_CHUNK){
+	grown = (char *) realloc(client->buffer, client->used + SERVER_CHUNK);
+	if(grown == NULL) return 0;
+	client->buffer = grown;
+	client->capacity = client->used + SERVER_CHUNK;
     }
-    i = size-1;
-    while (word[i] != letter){
-	new_word[i-2] = word[i];
-	i--;
+    got = read(client->fd, client->buffer + client->used, SERVER_CHUNK);
+    if(got < 0 && errno == EINTR) return 1;
+    if(got <= 0) return 0;
+    if(!server_next_line(client, NULL, NULL)) client->received = wall_seconds();
+    client->used += got;
+    return 1;
+}
+
+//// server_next_line function
+// Given a client and pointers to an end and a length (may be NULL), returns
+// 1 if client has an unanswered line and stores the end of its first line,
+// past its newline, in end and its length, without newline, in length; else
+// returns 0. Once client has ended, its last bytes are a line.
+short server_next_line(server_client * client, size_t * end, int * length)
+{
+    char * newline = NULL;
+    size_t line_end = 0, next = 0;
+
+    if(client->start == client->used) return 0;
+    newline = (char *) memchr(client->buffer + client->start, '\n',
+			      client->used - client->start);
+    if(newline != NULL){
+	line_end = newline - client->buffer;
+	next = line_end + 1;
     }
-    i--;
-    while (word[i] != letter){
-	new_word[new_size++] = word[i--];
+    else if(client->ended) line_end = next = client->used;
+    else return 0;
+    if(line_end - client->start >= SERVER_MAX_LINE) return 0;
+    if(end != NULL) *end = next;
+    if(length != NULL) *length = (int) (line_end - client->start);
+    return 1;
+}
+
+//// server_take_requests function
+// Given clients with their count, room for BATCH_WORDS requests, a pool
+// and arrays of words and sizes, takes the unanswered lines of clients
+// round robin, up to BATCH_WORDS of them, as requests. Lines holding a word
+// are parsed into words and sizes, in order of requests; blank lines are
+// skipped. Requests whose line is not a word get word -1, and those whose
+// word could not be alloc'd get -2. Returns the number of requests.
+int server_take_requests(server_client * clients, int count,
+			 server_request * requests, word_pool * pool,
+			 unsigned short ** words, int * sizes)
+{
+    server_client * client = NULL;
+    server_request * request = NULL;
+    size_t end = 0;
+    int request_count = 0, word_count = 0, length = 0, i = 0, j = 0;
+    short taken = 1;
+    char * line = NULL;
+
+    while(taken && request_count < BATCH_WORDS){
+	taken = 0;
+	for(i = 0; i < count && request_count < BATCH_WORDS; i++){
+	    client = &clients[i];
+	    if(!server_next_line(client, &end, &length)) continue;
+	    taken = 1;
+	    line = client->buffer + client->start;
+	    // Trims white space around word
+	    while(length > 0 && isspace((unsigned char) line[length - 1]))
+		length--;
+	    while(length > 0 && isspace((unsigned char) line[0])){
+		line++;
+		length--;
+	    }
+	    client->start = end;
+	    if(length == 0) continue;
+	    request = &requests[request_count++];
+	    request->client = i;
+	    request->offset = line - client->buffer;
+	    request->length = length;
+	    request->word = -1;
+	    for(j = 0; j < length; j++)
+		if(!isdigit((unsigned char) line[j]) &&
+		   !ispunct((unsigned char) line[j]))
+		    break;
+	    if(j < length) continue;	// Not a word, as for the command line
+	    // +1 so that the empty word gets memory too
+	    words[word_count] = pool_alloc(pool, length + 1);
+	    request->word = -2;
+	    if(words[word_count] == NULL) continue;
+	    sizes[word_count] = ni_parse_word(line, length, words[word_count]);
+	    request->word = (sizes[word_count] < 0)? -1: word_count++;
+	}
     }
-    return new_word;
+    return request_count;
 }
 
-////relabel function
-// Given a DOW w and its size, returns the word obtained from w after relabelling
-unsigned short * relabel(unsigned short * word, int size)
+//// server_respond function
+// Given clients with their count, count requests taken from them with the
+// nesting indices of their words and the bound of options, writes each
+// response to its client and moves the unanswered bytes of clients to the
+// start of their buffers. Clients whose responses could not be written end.
+void server_respond(server_client * clients, int client_count,
+		    server_request * requests, int count, int * NIs, int bound)
 {
-    unsigned short * new_word = (unsigned short *) \
-	malloc(sizeof(unsigned short)*size);
-    unsigned short new_ltr = 1;
-    int i, j;
-	
-    if(new_word == NULL){
-	free(word);
-	printf("Memory could not be alloc'd for new_word (relabel)");
-	exit(1);
+    server_client * client = NULL;
+    server_request * request = NULL;
+    double now = wall_seconds();
+    int i = 0, NI = 0;
+
+    for(i = 0; i < count; i++){
+	request = &requests[i];
+	client = &clients[request->client];
+	NI = (request->word < 0)? 0: NIs[request->word];
+	fprintf(client->out, "%.*s: ", request->length,
+		client->buffer + request->offset);
+	if(request->word == -1) fprintf(client->out, "not recognized");
+	else if(request->word == -2 || NI == NI_NO_MEMORY)
+	    fprintf(client->out, "out of memory");
+	else if(NI == NI_NOT_DOW) fprintf(client->out, "not DOW");
+	else if(NI == NI_ABOVE_BOUND) fprintf(client->out, "> %d", bound);
+	else if(NI == NI_OVER_BUDGET) fprintf(client->out, "over budget");
+	else fprintf(client->out, "%d", NI);
+	fprintf(client->out, " %.0fus\r\n", 1e6*(now - client->received));
     }
-    for(i = 0; i < size; i++){
-	for(j = i+1; j < size; j++){
-	    if (word[i] == word[j]){
-		new_word[i] = new_ltr;
-		new_word[j] = new_ltr++;
-	    }
+    // Lines left unanswered keep the clock of their arrival
+    for(i = 0; i < client_count; i++){
+	client = &clients[i];
+	if(client->start == 0) continue;
+	if(fflush(client->out) != 0){
+	    client->ended = 1;
+	    client->used = client->start;	// Nothing more is answered
 	}
+	memmove(client->buffer, client->buffer + client->start,
+		client->used - client->start);
+	client->used -= client->start;
+	client->start = 0;
     }
-    free(word);
-    return new_word;
+}
+
+//// print_stats function
+// Given a file, the index of a word in input, its size, its nesting index
+// (or error) and its statistics, prints them to file as a line of JSON.
+void print_stats(FILE * file, unsigned long long id, int size, int NI,
+		 ni_stats * stats)
+{
+    int i = 0;
+
+    fprintf(file, "{\"word\": %llu, \"size\": %d, \"NI\": %d, "
+	    "\"steps\": %llu, \"children\": %llu, \"duplicates\": %llu, "
+	    "\"subwords\": %llu, \"frontier\": [", id, size, NI,
+	    stats->steps, stats->children, stats->duplicates, stats->subwords);
+    for(i = 0; i < stats->levels && i < STATS_LEVELS; i++)
+	fprintf(file, (i == 0)? "%llu": ", %llu", stats->frontier[i]);
+    fprintf(file, "], \"levels\": %d, \"peak_frontier_bytes\": %lu, "
+	    "\"seconds\": %.6f}\n", stats->levels,
+	    (unsigned long) stats->peak_bytes, stats->seconds);
+}
+
+//// print_run_stats function
+// Given a file, statistics of a run and the mode of the run, prints them to
+// file as a line of JSON.
+void print_run_stats(FILE * file, run_stats * run, const char * mode)
+{
+    fprintf(file, "{\"run\": \"%s\", \"words\": %llu, \"steps\": %llu, "
+	    "\"children\": %llu, \"duplicates\": %llu, \"subwords\": %llu, "
+	    "\"peak_frontier_bytes\": %lu, \"read_seconds\": %.6f, "
+	    "\"reduce_seconds\": %.6f, \"write_seconds\": %.6f, "
+	    "\"total_seconds\": %.6f}\n", mode, run->words, run->totals.steps,
+	    run->totals.children, run->totals.duplicates, run->totals.subwords,
+	    (unsigned long) run->totals.peak_bytes, run->read, run->reduce,
+	    run->write, wall_seconds() - run->start);
+}
+
+//// time_phase function
+// Given the seconds of a phase and the clock at its start, adds the time
+// since start to phase and returns the clock, which starts the next phase.
+double time_phase(double * phase, double start)
+{
+    double now = wall_seconds();
+
+    *phase += now - start;
+    return now;
 }
 
 
@@ -869,139 +2308,308 @@ unsigned short * relabel(unsigned short * word, int size)
 // with newline characters.
 void print_word(unsigned short * word, int size, short return_bool)
 {
-    int i = 0;
-    if(size >= 20){
-	for(i = 0; i < size - 1; i++)
-	    printf("%u,", word[i]);
-	printf("%u", word[size - 1]);
+    file_print_word(stdout, word, size, return_bool);
+}
+
+
+//// print_NI function
+// Given a file, a nesting index (or value returned by get_NI_bounded in its
+// place) and the bound of query, prints it followed by \r\n
+void print_NI(FILE * file, int NI, int bound)
+{
+    if(NI == NI_ABOVE_BOUND) fprintf(file, "> %d\r\n", bound);
+    else fprintf(file, "%d\r\n", NI);
+}
+
+//// print_bounds function
+// Given a file and the stats of a word stopped by a limit, prints the bounds
+// on its nesting index and the limit, as in "between 3 and 5 (time limit)",
+// followed by \r\n. An unknown upper bound is printed as "?".
+void print_bounds(FILE * file, ni_stats * stats)
+{
+    fprintf(file, "between %d and ", stats->lower_bound);
+    if(stats->upper_bound == NI_UNBOUNDED) fprintf(file, "?");
+    else fprintf(file, "%d", stats->upper_bound);
+    fprintf(file, " (%s limit)\r\n", limit_name(stats->limit));
+}
+
+//// limit_name function
+// Given a limit of ni_stats, returns its name.
+const char * limit_name(int limit)
+{
+    switch(limit){
+    case NI_LIMIT_TIME: return "time";
+    case NI_LIMIT_FRONTIER: return "frontier";
+    case NI_LIMIT_MEMORY: return "memory";
+    default: return "no";
     }
-    else{
-	for(i = 0; i < size; i++)
-	    printf("%u", word[i]);
+}
+
+//// cut_off_add function
+// Given a list of words cut off, the index in input of a word stopped by a
+// limit, the word, its size and its stats, adds word to list. Returns 0 if
+// memory could not be alloc'd, else 1.
+short cut_off_add(cut_off_list * list, unsigned long long id,
+		  unsigned short * word, int size, ni_stats * stats)
+{
+    cut_off * grown = NULL, * entry = NULL;
+    size_t capacity = 0;
+
+    if(list->count == list->capacity){
+	capacity = (list->capacity == 0)? 64: 2*list->capacity;
+	grown = (cut_off *) realloc(list->entries, sizeof(cut_off)*capacity);
+	if(grown == NULL) return 0;
+	list->entries = grown;
+	list->capacity = capacity;
+    }
+    entry = &list->entries[list->count];
+    entry->word = pool_alloc(&list->pool, size);
+    if(entry->word == NULL) return 0;
+    memcpy(entry->word, word, sizeof(unsigned short)*size);
+    entry->id = id;
+    entry->size = size;
+    entry->limit = stats->limit;
+    entry->lower_bound = stats->lower_bound;
+    entry->upper_bound = stats->upper_bound;
+    list->count++;
+    if(stats->limit >= 0 && stats->limit <= NI_LIMIT_MEMORY)
+	list->by_limit[stats->limit]++;
+    return 1;
+}
+
+//// print_cut_offs function
+// Given a file and a list of words cut off, prints the number of them
+// stopped by each limit and then a line for each of them: its index in
+// input, the word and the bounds on its nesting index. Prints nothing if
+// list is empty.
+void print_cut_offs(FILE * file, cut_off_list * list)
+{
+    cut_off * entry = NULL;
+    size_t i = 0;
+
+    if(list->count == 0) return;
+    fprintf(file, "Cut off %lu words: %llu by time, %llu by frontier, "
+	    "%llu by memory\n", (unsigned long) list->count,
+	    list->by_limit[NI_LIMIT_TIME], list->by_limit[NI_LIMIT_FRONTIER],
+	    list->by_limit[NI_LIMIT_MEMORY]);
+    for(i = 0; i < list->count; i++){
+	entry = &list->entries[i];
+	fprintf(file, "%llu ", entry->id);
+	file_print_word(file, entry->word, entry->size, 0);
+	fprintf(file, ": lower %d, upper ", entry->lower_bound);
+	if(entry->upper_bound == NI_UNBOUNDED) fprintf(file, "?");
+	else fprintf(file, "%d", entry->upper_bound);
+	fprintf(file, " (%s limit)\n", limit_name(entry->limit));
+    }
+}
+
+//// print_class function
+// Given a file, the nesting indices of the words of a class (in the order
+// of ni_isomorphisms) with their count and the bound on NIs, prints the
+// least and greatest of them and then all of them, as in
+// "min 1, max 2, NIs 1,2,2,1,1,2". NIs above bound are printed as "> k",
+// or ">k" in the list, and words whose NI was not found as "?".
+void print_class(FILE * file, int * NIs, int count, int bound)
+{
+    int i = 0, min = class_min(NIs, count), max = NI_NOT_DOW;
+
+    if(NIs[0] == NI_NOT_DOW){
+	fprintf(file, "not DOW\r\n");
+	return;
+    }
+    for(i = 0; i < count; i++){
+	if(NIs[i] == NI_ABOVE_BOUND) max = INT_MAX;
+	else if(NIs[i] > max) max = NIs[i];
+    }
+    fprintf(file, "min ");
+    print_class_NI(file, (min == NI_ABOVE_BOUND)? INT_MAX: min, bound, " ");
+    fprintf(file, ", max ");
+    print_class_NI(file, max, bound, " ");
+    fprintf(file, ", NIs ");
+    for(i = 0; i < count; i++){
+	if(i > 0) fputc(',', file);
+	print_class_NI(file, (NIs[i] == NI_ABOVE_BOUND)? INT_MAX: NIs[i],
+		       bound, "");
     }
-    if(return_bool)	printf("\r\n");
+    fprintf(file, "\r\n");
 }
 
+//// print_class_NI function
+// Given a file, a nesting index of print_class (INT_MAX if above bound,
+// negative if not found), the bound and the separator of "> k", prints NI.
+void print_class_NI(FILE * file, int NI, int bound, const char * separator)
+{
+    if(NI == INT_MAX) fprintf(file, ">%s%d", separator, bound);
+    else if(NI < 0) fprintf(file, "?");
+    else fprintf(file, "%d", NI);
+}
+
+//// class_min function
+// Given the nesting indices of the words of a class and their count, returns
+// the least of them, NI_ABOVE_BOUND if all are above bound, or the error of
+// the first word if none was found.
+int class_min(int * NIs, int count)
+{
+    int i = 0, min = INT_MAX;
+
+    for(i = 0; i < count; i++)
+	if(NIs[i] >= 0 && NIs[i] < min) min = NIs[i];
+    if(min != INT_MAX) return min;
+    for(i = 0; i < count && NIs[i] != NI_ABOVE_BOUND; i++);
+    return (i < count)? NI_ABOVE_BOUND: NIs[0];
+}
 
 //// file_print_word function
 // same as print_word function but prints to file 
 void file_print_word(FILE * file, unsigned short * word, int size, short return_bool)
 {
-    int i = 0;
-    if(size >= 20){
-	for(i = 0; i < size - 1; i++)
-	    fprintf(file, "%u,", word[i]);
-	fprintf(file, "%u", word[size - 1]);
+    char text[WORD_TEXT_ROOM];
+    int i = 0, length = 0;
+
+    // Letters are formatted into text, which is written when nearly full
+    for(i = 0; i < size; i++){
+	if(length > WORD_TEXT_ROOM - 8){
+	    fwrite(text, 1, length, file);
+	    length = 0;
+	}
+	length += format_letter(text + length, word[i]);
+	if(size >= 20 && i < size - 1) text[length++] = ',';
     }
-    else{
-	for(i = 0; i < size; i++)
-	    fprintf(file, "%u", word[i]);
+    if(return_bool){
+	text[length++] = '\r';
+	text[length++] = '\n';
     }
-    if(return_bool)	fprintf(file, "\r\n");
+    fwrite(text, 1, length, file);
 }
 
-//// get_reverse function
-// Given a word and its size returns the reverse of that word.
-unsigned short * get_reverse(unsigned short * word, int size)
+//// format_letter function
+// Given room for 5 chars and a letter, writes the decimal digits of letter
+// to text and returns their number.
+int format_letter(char * text, unsigned int letter)
 {
-    unsigned short * reverse = (unsigned short *) malloc(sizeof(short)*(size));
-    int i = 0;
+    char digits[5];
+    int count = 0, i = 0;
 
-    if(reverse == NULL){
-	free(word);
-	printf("mem could not be alloc'd for reverse");
-	exit(1);
-    }
-    for(i = 0; i < size; i++)
-	reverse[i] = word[(size - 1) - i];
-	
-    reverse = relabel(reverse, size);
-    return reverse;
+    do{
+	digits[count++] = '0' + letter%10;
+	letter /= 10;
+    } while(letter > 0);
+    for(i = 0; i < count; i++) text[i] = digits[count - 1 - i];
+    return count;
 }
 
+//// pool_init function
+// Given a word pool, makes it empty. No memory is alloc'd until first use.
+void pool_init(word_pool * pool)
+{
+    pool->first = NULL;
+    pool->current = NULL;
+}
 
-//// get_isomorphisms functions
-// Given a word, its size and a pointer to an int count, returns array of
-// cyclically equivalent words and updates count with the number of words
-// in returned array.
-unsigned short ** get_isomorphisms(unsigned short * word, int size, int * count){
-    unsigned short ** isomorphisms;
-    unsigned short * temp_word, * reverse;
-    int i = 0, offset;
-    short isDup = 0;
-	
-    *count = 0;
-    isomorphisms = (unsigned short **) malloc(sizeof(short *)*(size));
-    temp_word = (unsigned short *) malloc(sizeof(short)*size);
-	
-    if(isomorphisms == NULL || temp_word == NULL){
-	free(word);
-	if(isomorphisms != NULL) free(isomorphisms);
-	if(temp_word != NULL) free(temp_word);
-	printf("mem could not be alloc'd for isomorphisms");
-	exit(1);
-    }
-    offset = 0;
-    isDup = 0;
-    while(offset < size && !isDup){
-	for(i = 0; i + offset < size; i++)
-	    temp_word[i] = word[i + offset];
-		
-	for(i = 0; i < offset; i++)
-	    temp_word[(size - offset) + i] = word[i];
-		
-	temp_word = relabel(temp_word, size);
-		
-	isDup = 0;
-	for(i = 0; i < *count && !isDup; i++)
-	    isDup = (memcmp(isomorphisms[i], temp_word, sizeof(short)*size) == 0);
-	if(!isDup){
-	    isomorphisms[*count] = temp_word;
-	    *count += 1;
-	    temp_word = malloc(sizeof(short)*(size));
-	    if(temp_word == NULL){
-		for(i = 0; i < *count; i++) free(isomorphisms[i]);
-		free(isomorphisms);
-		free(word);
-		printf("Memory could not be alloc'd for temp_word (1)");
-		exit(1);
-	    }
-	    offset++;
+//// pool_alloc function
+// Given a word pool and a number of letters, returns room for that many
+// letters from pool, or NULL if memory could not be alloc'd. Room is taken
+// from the current block, else from the next block kept from before a reset,
+// else from a new block twice as large as the last.
+unsigned short * pool_alloc(word_pool * pool, int count)
+{
+    pool_block * block = pool->current, * new_block = NULL;
+    size_t capacity = POOL_MIN_LETTERS;
+    unsigned short * room = NULL;
+
+    if(block != NULL && block->used + count > block->capacity){
+	if(block->next != NULL && (size_t) count <= block->next->capacity)
+	    block = block->next;
+	else{
+	    capacity = 2*block->capacity;
+	    block = NULL;
 	}
     }
-	
-    // Same as above, only with reverse.
-    reverse = get_reverse(word, size);
-    offset = 0;
-    isDup = 0;
-    while(offset < size && !isDup){
-	for(i = 0; i + offset < size; i++)
-	    temp_word[i] = reverse[i + offset];
-		
-	for(i = 0; i < offset; i++)
-	    temp_word[(size - offset) + i] = reverse[i];
-		
-	temp_word = relabel(temp_word, size);
-		
-	isDup = 0;
-	for(i = 0; i < *count && !isDup; i++)
-	    isDup = (memcmp(isomorphisms[i], temp_word, sizeof(short)*size) == 0);
-	if(!isDup){
-	    isomorphisms[*count] = temp_word;
-	    *count += 1;
-	    temp_word = malloc(sizeof(short)*(size));
-	    if(temp_word == NULL){
-		for(i = 0; i < *count; i++) free(isomorphisms[i]);
-		free(isomorphisms);
-		free(reverse);
-		free(word);
-		printf("Memory could not be alloc'd for temp_word (2)");
-		exit(1);
-	    }
-	    offset++;
+    if(block == NULL){
+	if(capacity < (size_t) count) capacity = count;
+	new_block = (pool_block *) malloc(sizeof(pool_block) +
+					  sizeof(unsigned short)*capacity);
+	if(new_block == NULL) return NULL;
+	new_block->capacity = capacity;
+	new_block->used = 0;
+	// New block goes after current, before blocks kept from a reset
+	if(pool->current == NULL){
+	    new_block->next = pool->first;
+	    pool->first = new_block;
+	}
+	else{
+	    new_block->next = pool->current->next;
+	    pool->current->next = new_block;
 	}
+	block = new_block;
     }
-    free(reverse);
-    free(temp_word);	
-    return isomorphisms;
+    pool->current = block;
+    room = block->letters + block->used;
+    block->used += count;
+    return room;
+}
+
+//// pool_reset function
+// Given a word pool, frees all words alloc'd from it at once. Blocks are
+// kept.
+void pool_reset(word_pool * pool)
+{
+    pool_block * block = NULL;
+
+    for(block = pool->first; block != NULL; block = block->next)
+	block->used = 0;
+    pool->current = pool->first;
+}
+
+//// pool_release function
+// Given a word pool, frees its blocks, leaving it empty.
+void pool_release(word_pool * pool)
+{
+    pool_block * block = pool->first, * next = NULL;
+
+    while(block != NULL){
+	next = block->next;
+	free(block);
+	block = next;
+    }
+    pool_init(pool);
+}
+
+//// hash_letters function
+// Given a word and its size, returns a hash of the word (FNV-1a over the
+// letters), for the word set of --canonical.
+unsigned int hash_letters(unsigned short * word, int size)
+{
+    unsigned int hash = 2166136261u;
+    int i = 0;
+
+    for(i = 0; i < size; i++){
+	hash ^= word[i];
+	hash *= 16777619u;
+    }
+    return hash;
+}
+
+//// add_word_stats function
+// Adds the counts of the stats of a word to those of total, keeping the
+// larger peak.
+void add_word_stats(ni_stats * total, ni_stats * stats)
+{
+    total->steps += stats->steps;
+    total->children += stats->children;
+    total->duplicates += stats->duplicates;
+    total->subwords += stats->subwords;
+    total->seconds += stats->seconds;
+    if(stats->peak_bytes > total->peak_bytes)
+	total->peak_bytes = stats->peak_bytes;
+}
+
+//// wall_seconds function
+// Returns seconds of a monotonic clock, for timing phases of a run.
+double wall_seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec/1e9;
 }
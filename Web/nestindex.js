@@ -9,10 +9,114 @@
 //						Possible that it could have gone out of subscript.
 //					- Update to reduction algorithm since old one did not
 //						recognize exact nesting index for all words
+//Update: Words are reduced by the C engine, built as WebAssembly, in a Web
+//			Worker (nestindex_worker.js) when the page can run one; the
+//			functions below reduce them in the page otherwise.
 //----------------------------------------------------------------------------
 
+var PATIENCE_MS = 250;	//busy worker is restarted after this, if it can't
+			//be told to cancel
+
+var engine_worker = null;	//worker of the engine, null if page reduces
+var engine_failed = false;
+var newest_id = null;		//Int32Array over counter shared with worker
+var request_id = 0;		//id of newest request posted
+var request_time = 0;		//time it was posted
+var shown_id = 0;		//id of newest result shown
+var request_classes = false;	//classes of newest request
+
+////start_engine function
+//starts the worker of the engine, unless the page can't run one
+function start_engine(){
+	if(engine_failed || typeof Worker === "undefined" ||
+	   typeof WebAssembly === "undefined"){
+		engine_failed = true;
+		return;
+	}
+	var worker = new Worker("nestindex_worker.js");
+	worker.onmessage = receive_reduction;
+	worker.onerror = function(){
+		//engine could not be loaded; reduce in page from now on
+		engine_failed = true;
+		worker.terminate();
+		engine_worker = null;
+		perform_reduction();
+	};
+	engine_worker = worker;
+	if(typeof SharedArrayBuffer !== "undefined" && self.crossOriginIsolated){
+		var shared = new SharedArrayBuffer(4);
+		newest_id = new Int32Array(shared);
+		Atomics.store(newest_id, 0, request_id);
+		engine_worker.postMessage({shared: shared});
+	}
+}
+
 ////main function - called from reductions user interface
 function perform_reduction(){
+	var word_form = document.getElementById("WordInput");
+	var circular_check = document.getElementById("circular");
+
+	if(engine_worker === null){start_engine()}
+	if(engine_worker === null){
+		reduce_in_page();
+		return;
+	}
+	if(request_id > shown_id && newest_id === null &&
+	   Date.now() - request_time > PATIENCE_MS){
+		//worker is still busy with a stale word and can't be told
+		//to stop; start a new one, whose memo table starts empty
+		engine_worker.terminate();
+		start_engine();
+	}
+	request_id = request_id + 1;
+	request_time = Date.now();
+	request_classes = circular_check.checked;
+	if(newest_id !== null){Atomics.store(newest_id, 0, request_id)}
+	engine_worker.postMessage({id: request_id, word: word_form.value,
+				   classes: request_classes});
+}
+
+////receive_reduction function
+//writes the reductions of a result of the worker, unless a newer request
+//has been posted
+function receive_reduction(event){
+	var data = event.data;
+	if(data.ready || data.id !== request_id){return}
+	shown_id = data.id;
+	document.getElementById("reductions").innerHTML = "";
+
+	var result = data.result;
+	if(result.error === "not DOW"){
+		var word = document.getElementById("WordInput").value;
+		write(word.split(",").join("") + " is not a double occurrence word!");
+		return;
+	}
+	else if(result.error){
+		write("The word could not be reduced: " + result.error);
+		return;
+	}
+	var words = result.words;
+	if(request_classes && words.length === 1 && words[0].word.length === 0){
+		write("The empty word has no circular word equivalencies!");
+	}
+	var min_NI = words[0].NI;
+	for(var i = 0; i < words.length; i++){
+		if(words[i].NI > 0){
+			var path = new Array();
+			for(var j = 0; j < words[i].NI; j++){
+				var step = words[i].steps[j];
+				path.push(step === 0 ? "1" : "2 (removal of  " + step + ")");
+			}
+			write_reduction({history: words[i].path, path: path});
+		}
+		if(words[i].NI < min_NI){min_NI = words[i].NI}
+	}
+	write("<br/><br/><big><b>The nesting index is: " + min_NI + "</b></big>");
+}
+
+////reduce_in_page function
+//reduces the word of the text entry in the page
+function reduce_in_page(){
 	var word_form = document.getElementById("WordInput");
 	var output_form = document.getElementById("reductions");
 	var circular_check = document.getElementById("circular");
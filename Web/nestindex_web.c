@@ -0,0 +1,241 @@
+// nestindex_web.c
+// ----------------------------------------------------------------------------
+// Purpose: Entry points of libnestindex built as WebAssembly for the web
+//          page nestindex_ui.html. The page runs them in a Web Worker
+//          (nestindex_worker.js), so reductions never block the page. A
+//          single context is kept for the life of the worker, so its memo
+//          table stays warm from one keystroke to the next.
+// ----------------------------------------------------------------------------
+// Results are handed to JavaScript as JSON text:
+//   {"words": [{"word": [1,2,2,1], "NI": 1, "path": [[1,2,2,1]],
+//               "steps": [0]}, ...]}
+// with one entry per word reduced, path and steps as from ni_reduction, or
+//   {"error": "not DOW"}
+// when word could not be reduced. As on the page before the engine, a word
+// is either digits, each a letter, or numbers separated by commas; other
+// text is not a DOW, and empty text is the empty word.
+// ----------------------------------------------------------------------------
+// To build nestindex_engine.js and nestindex_engine.wasm with Emscripten,
+// run from the top directory:
+// >> make wasm
+// ----------------------------------------------------------------------------
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>	//contains isdigit function
+#include <emscripten.h>
+
+#include "nestindex.h"
+
+
+// Result type
+// The JSON text of the last result, in a buffer that grows as needed.
+typedef struct web_result {
+    char * text;
+    size_t length;
+    size_t capacity;
+    short failed;		// Memory could not be alloc'd for text
+} web_result;
+
+static ni_context * web_context = NULL;
+static web_result result = {NULL, 0, 0, 0};
+
+
+// Function templates
+int web_cancel(void *);
+int web_init(int);
+const char * web_reduce(const char *, int);
+short web_word_valid(const char *, int);
+void result_reset(void);
+void result_append(const char *, ...);
+void result_append_word(unsigned short *, int);
+short result_append_reduction(unsigned short *, int);
+
+
+//// web_cancelled function
+// Returns nonzero once the page has asked for a newer reduction than the
+// one running; see nestindex_worker.js.
+EM_JS(int, web_cancelled, (void), {
+    return Module.cancelled ? Module.cancelled() : 0;
+});
+
+//// web_cancel function
+// Cancel function of the context of the page.
+int web_cancel(void * arg)
+{
+    (void) arg;
+    return web_cancelled();
+}
+
+//// web_init function
+// Given a memo budget in megabytes, makes the context of the page, which
+// reduces words on a single thread and stops when web_cancelled asks.
+// Returns NI_OK, or NI_NO_MEMORY if context could not be made.
+EMSCRIPTEN_KEEPALIVE
+int web_init(int memo_mb)
+{
+    ni_options options;
+
+    ni_default_options(&options);
+    options.memo_budget = (size_t) memo_mb << 20;
+    options.cancel = web_cancel;
+    ni_context_free(web_context);
+    web_context = ni_context_create(&options);
+    return (web_context == NULL)? NI_NO_MEMORY: NI_OK;
+}
+
+//// web_reduce function
+// Given the text of a word (as typed on the page) and classes, returns the
+// JSON text (see top of file) of a shortest reduction of word or, if classes
+// is set, of each word cyclically equivalent to word or to its reverse. The
+// text is valid until the next call.
+EMSCRIPTEN_KEEPALIVE
+const char * web_reduce(const char * text, int classes)
+{
+    int length = strlen(text), size = 0, count = 0, i = 0;
+    unsigned short * word = NULL, * isomorphisms = NULL;
+    short ok = 1;
+
+    result_reset();
+    if(!web_word_valid(text, length)){
+	result_append("{\"error\": \"%s\"}", ni_error_string(NI_NOT_DOW));
+	return result.failed? "{\"error\": \"out of memory\"}": result.text;
+    }
+    // +1 so that the empty word gets memory too
+    word = (unsigned short *) malloc(sizeof(unsigned short)*(length + 1));
+    if(word == NULL || web_context == NULL){
+	free(word);
+	return "{\"error\": \"out of memory\"}";
+    }
+    size = ni_parse_word(text, length, word);
+    if(classes && size > 0){
+	isomorphisms = (unsigned short *) \
+	    malloc(sizeof(unsigned short)*NI_ISOMORPHISMS_ROOM(size));
+	if(isomorphisms == NULL){
+	    free(word);
+	    return "{\"error\": \"out of memory\"}";
+	}
+	count = ni_isomorphisms(word, size, isomorphisms);
+    }
+    result_append("{\"words\": [");
+    if(isomorphisms == NULL) ok = result_append_reduction(word, size);
+    for(i = 0; i < count && ok; i++){
+	if(i > 0) result_append(", ");
+	ok = result_append_reduction(isomorphisms + (size_t) i*size, size);
+    }
+    if(ok) result_append("]}");	// Else result holds the error
+    free(isomorphisms);
+    free(word);
+    if(result.failed) return "{\"error\": \"out of memory\"}";
+    return result.text;
+}
+
+//// web_word_valid function
+// Given the text of a word and its length, returns 1 if text is empty, all
+// digits or numbers separated by single commas, as the page read words, else
+// 0. ni_parse_word takes more delimiters and skips empty letters, so text
+// the page did not take could otherwise be reduced as another word.
+short web_word_valid(const char * text, int length)
+{
+    int i = 0;
+    short commas = (memchr(text, ',', length) != NULL), in_letter = 0;
+
+    for(i = 0; i < length; i++){
+	if(isdigit((unsigned char) text[i])) in_letter = 1;
+	else if(commas && text[i] == ',' && in_letter) in_letter = 0;
+	else return 0;
+    }
+    return (length == 0 || in_letter);
+}
+
+//// result_reset function
+// Empties the result text.
+void result_reset(void)
+{
+    result.length = 0;
+    result.failed = 0;
+    if(result.text != NULL) result.text[0] = '\0';
+}
+
+//// result_append function
+// Given a format and its arguments, as for printf, appends them to result.
+void result_append(const char * format, ...)
+{
+    va_list args;
+    char * grown = NULL;
+    int needed = 0;
+
+    va_start(args, format);
+    needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if(result.failed || needed < 0) return;
+    if(result.length + needed + 1 > result.capacity){
+	grown = (char *) realloc(result.text, 2*(result.length + needed + 1));
+	if(grown == NULL){
+	    result.failed = 1;
+	    return;
+	}
+	result.text = grown;
+	result.capacity = 2*(result.length + needed + 1);
+    }
+    va_start(args, format);
+    vsnprintf(result.text + result.length, needed + 1, format, args);
+    va_end(args);
+    result.length += needed;
+}
+
+//// result_append_word function
+// Given a word and its size, appends it to result as a JSON array.
+void result_append_word(unsigned short * word, int size)
+{
+    int i = 0;
+
+    result_append("[");
+    for(i = 0; i < size; i++) result_append((i == 0)? "%u": ",%u", word[i]);
+    result_append("]");
+}
+
+//// result_append_reduction function
+// Given a word and its size, appends the JSON object of its shortest
+// reduction to result. If word could not be reduced, result is replaced by
+// the error. Returns 0 in that case, else 1.
+short result_append_reduction(unsigned short * word, int size)
+{
+    unsigned short * path = NULL;
+    int * sizes = NULL, * steps = NULL;
+    int NI = 0, i = 0;
+    size_t offset = 0;
+
+    // +1 so that the empty word gets memory too
+    path = (unsigned short *) malloc(sizeof(unsigned short)*
+				     (NI_REDUCTION_ROOM(size) + 1));
+    sizes = (int *) malloc(sizeof(int)*(size/2 + 1));
+    steps = (int *) malloc(sizeof(int)*(size/2 + 1));
+    NI = (path == NULL || sizes == NULL || steps == NULL)? NI_NO_MEMORY:
+	ni_reduction(web_context, word, size, path, sizes, steps);
+    if(NI < 0){
+	result_reset();
+	result_append("{\"error\": \"%s\"}", ni_error_string(NI));
+    }
+    else{
+	result_append("{\"word\": ");
+	result_append_word(word, size);
+	result_append(", \"NI\": %d, \"path\": [", NI);
+	for(i = 0; i < NI; i++){
+	    if(i > 0) result_append(", ");
+	    result_append_word(path + offset, sizes[i]);
+	    offset += sizes[i];
+	}
+	result_append("], \"steps\": [");
+	for(i = 0; i < NI; i++)
+	    result_append((i == 0)? "%d": ", %d", steps[i]);
+	result_append("]}");
+    }
+    free(path);
+    free(sizes);
+    free(steps);
+    return (NI >= 0);
+}
@@ -0,0 +1,73 @@
+//-----------------------------------------------------------------------------
+//nestindex_worker.js
+//Purpose: Web Worker that reduces words for nestindex_ui.html with the C
+//         engine built as WebAssembly (nestindex_engine.js, see
+//         nestindex_web.c). The page posts {id, word, classes} for each
+//         keystroke and gets back {id, result}. Only the newest request is
+//         reduced: requests that arrive while one runs replace each other,
+//         and the running one is cancelled if the page shares a counter of
+//         its newest id (a SharedArrayBuffer). The engine keeps its memo
+//         table between requests.
+//-----------------------------------------------------------------------------
+
+importScripts("nestindex_engine.js");
+
+var MEMO_MB = 64;
+
+var engine = null;		//module of the engine, once loaded
+var pending = null;		//newest request not yet reduced
+var scheduled = false;
+var newest_id = null;		//Int32Array over counter shared by page
+var running_id = 0;
+
+NestIndexEngine({
+	//called by the engine now and then while reducing
+	cancelled: function(){
+		return newest_id !== null && Atomics.load(newest_id, 0) !== running_id;
+	}
+}).then(function(module){
+	engine = module;
+	engine._web_init(MEMO_MB);
+	postMessage({ready: true});
+	schedule();
+});
+
+////onmessage function
+//takes the shared counter, or a request that replaces any pending one
+onmessage = function(event){
+	if(event.data.shared){
+		newest_id = new Int32Array(event.data.shared);
+		return;
+	}
+	pending = event.data;
+	schedule();
+};
+
+////schedule function
+//runs the pending request once messages already queued have been taken,
+//so that a burst of keystrokes is reduced once
+function schedule(){
+	if(!scheduled){
+		scheduled = true;
+		setTimeout(run, 0);
+	}
+}
+
+////run function
+//reduces the pending request and posts its result
+function run(){
+	scheduled = false;
+	if(engine === null || pending === null){return}
+	var request = pending;
+	pending = null;
+	if(newest_id !== null && Atomics.load(newest_id, 0) !== request.id){
+		return;	//a newer request is on its way
+	}
+	running_id = request.id;
+	var text = engine.ccall("web_reduce", "string", ["string", "number"],
+		[request.word, request.classes ? 1 : 0]);
+	var result = JSON.parse(text);
+	if(result.error !== "cancelled"){
+		postMessage({id: request.id, result: result});
+	}
+}
@@ -0,0 +1,215 @@
+// nestindex.h
+// ----------------------------------------------------------------------------
+// Purpose: Interface of libnestindex, the reduction engine of NestIndex as a
+//          library. Nesting indices are computed through a context, which
+//          holds the memo tables of known nesting indices and the options of
+//          the computation. A context may be shared by several threads: each
+//          call takes a memo table no other call is using, or runs without
+//          one. With several jobs, the memo tables share a table of their
+//          own, so words reduced by one thread are known to all. Calls never
+//          exit or print; they return nesting indices or the error codes
+//          below, and write results to caller-provided buffers.
+// ----------------------------------------------------------------------------
+// Words are arrays of unsigned short letters. A double occurrence word (DOW)
+// has each of its letters exactly twice. Words of more than 2*65535 letters,
+// too many to relabel, are taken as not DOWs. Link with -lnestindex
+// -pthread.
+// ----------------------------------------------------------------------------
+#ifndef NESTINDEX_H
+#define NESTINDEX_H
+
+#include <stddef.h>
+#include <limits.h>	//contains INT_MAX
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Functions exported by the shared library
+#if defined(__GNUC__)
+#define NI_API __attribute__((visibility("default")))
+#else
+#define NI_API
+#endif
+
+// Values returned instead of a nesting index
+#define NI_OK 0			// Call succeeded (calls not returning NIs)
+#define NI_NOT_DOW -1		// Word is not double occurrence
+#define NI_NO_MEMORY -2		// Memory could not be alloc'd
+#define NI_ABOVE_BOUND -3	// Nesting index is above bound of options
+#define NI_BAD_ARGUMENT -4	// Argument of call is not valid
+#define NI_BAD_DATABASE -5	// Database could not be opened or is not one
+#define NI_CANCELLED -6		// Cancel function of options stopped reduction
+#define NI_OVER_BUDGET -7	// Word hit a limit of options; see ni_stats
+#define NI_UNBOUNDED INT_MAX	// Bound of options with no bound
+
+// Search engines for nesting index
+#define ENGINE_BFS 0		// Builds every word of each level of reduction
+#define ENGINE_DFS 1		// Depth first with iterative deepening
+
+// Options of a context
+typedef struct ni_options {
+    size_t memo_budget;		// Bytes for memo tables of all jobs and the
+				// table they share, 0 is off
+    int jobs;			// Threads of a batch, or of levels of a word
+    int bound;			// NIs above bound give NI_ABOVE_BOUND
+    int engine;			// ENGINE_BFS or ENGINE_DFS
+    size_t table_budget;	// Bytes for depths refuted by ENGINE_DFS
+    int (*cancel)(void *);	// Called with cancel_arg now and then while
+    void * cancel_arg;		// reducing; nonzero stops with NI_CANCELLED
+    double time_limit;		// Seconds per word, 0 is none
+    size_t frontier_limit;	// Words of a level of ENGINE_BFS, 0 is none
+    size_t memory_limit;	// Bytes of a level of ENGINE_BFS, 0 is none
+} ni_options;
+
+// Limits of options that cut a reduction off with NI_OVER_BUDGET. Time is
+// checked once per level of ENGINE_BFS and per word searched by ENGINE_DFS;
+// a level of ENGINE_BFS is expanded only if it holds no more than the
+// frontier limit of words and it and the pointers and sizes of the next
+// level fit in the memory limit (the letters of the next level are not
+// known in advance).
+#define NI_LIMIT_NONE 0
+#define NI_LIMIT_TIME 1
+#define NI_LIMIT_FRONTIER 2
+#define NI_LIMIT_MEMORY 3
+
+// Statistics of the reduction of a word
+#define STATS_LEVELS 64
+typedef struct ni_stats {
+    unsigned long long steps;		// Reduction steps taken
+    unsigned long long children;	// Words made by steps
+    unsigned long long duplicates;	// Children dropped as duplicates
+    unsigned long long subwords;	// Maximal subwords found by steps
+    unsigned long long frontier[STATS_LEVELS];	// Words of each level
+    int levels;
+    size_t peak_bytes;		// Largest level: letters, pointers and sizes
+    double seconds;		// Wall time reducing word
+    int limit;			// NI_LIMIT_* of word if NI_OVER_BUDGET, when
+    int lower_bound;		// NI is at least lower_bound and at most
+    int upper_bound;		// upper_bound (NI_UNBOUNDED if none is known)
+} ni_stats;
+
+// Counts of the memo tables of a context
+typedef struct ni_memo_counts {
+    unsigned long hits, misses, evictions;
+    unsigned long entries;	// Nesting indices held
+    unsigned long bytes;	// Memory used
+    int tables;			// Memo tables alloc'd
+    unsigned long db_hits;	// Memo misses found in database
+    unsigned long db_misses;
+    unsigned long long db_entries;	// Nesting indices held by database
+    unsigned long shared_hits;		// Memo misses found in shared table
+    unsigned long shared_misses;
+    unsigned long shared_evictions;
+    unsigned long shared_entries;	// Nesting indices held by shared table
+    unsigned long shared_bytes;		// Memory used, 0 if there is none
+} ni_memo_counts;
+
+typedef struct ni_context ni_context;
+
+// Room in letters that ni_isomorphisms needs for a word of size letters
+#define NI_ISOMORPHISMS_ROOM(size) (2*(size_t) (size)*(size_t) (size))
+
+// Sets options to the defaults: 64 MB of memo, one job, no bound, ENGINE_BFS,
+// 64 MB of refuted depths, no cancel function and no limits.
+NI_API void ni_default_options(ni_options * options);
+
+// Returns a new context with options (defaults if NULL), or NULL if options
+// are not valid or memory could not be alloc'd. With several jobs and a
+// memo budget of about 6 MB or more (on 64-bit builds), a quarter of it is
+// split among the memo tables of jobs and the rest goes to the table they
+// share. Memo tables that cannot be alloc'd are left out; see ni_memo_stats.
+NI_API ni_context * ni_context_create(const ni_options * options);
+
+// Frees context, its memo tables and its database handle. No call may be
+// using it.
+NI_API void ni_context_free(ni_context * context);
+
+// Opens the NI database at path for context, creating it unless read_only
+// is set. Nesting indices of words missing from the memo tables of context
+// are looked up in it, and those computed are added to it unless read_only
+// is set. The database is a file shared by runs and by processes;
+// a read-only context sees the words it held when opened. Call before
+// context computes anything. Returns NI_OK, NI_BAD_DATABASE or NI_NO_MEMORY.
+NI_API int ni_context_open_db(ni_context * context, const char * path,
+			      int read_only);
+
+// Returns the nesting index of word, or NI_NOT_DOW, NI_NO_MEMORY,
+// NI_ABOVE_BOUND, NI_CANCELLED, NI_OVER_BUDGET or NI_BAD_ARGUMENT. Levels of
+// the reduction are expanded by the jobs of context. If stats is not NULL,
+// it gets the statistics of the reduction, and the bounds on nesting index
+// known when word hit a limit. word is not modified.
+NI_API int ni_compute(ni_context * context, const unsigned short * word,
+		      int size, ni_stats * stats);
+
+// Given count words with their sizes, stores the nesting index (or error) of
+// each word in NIs and, if stats is not NULL, its statistics in stats.
+// Words are reduced by the jobs of context, each taking the next word not
+// yet taken. Returns NI_OK, or NI_BAD_ARGUMENT if arguments are not valid.
+NI_API int ni_compute_batch(ni_context * context,
+			    const unsigned short * const * words,
+			    const int * sizes, int count, int * NIs,
+			    ni_stats * stats);
+
+// Room in nesting indices that ni_compute_classes needs for the class of a
+// word of size letters
+#define NI_CLASS_ROOM(size) (2*(size_t) (size) + 1)
+
+// Given count words with their sizes, stores in NIs[i] (room for
+// NI_CLASS_ROOM(sizes[i])) the nesting index (or error) of each word
+// cyclically equivalent to words[i], in the order of ni_isomorphisms, and
+// in class_sizes[i] their number, or NI_NO_MEMORY. A word that is not a DOW
+// gets a class of its own with NI_NOT_DOW. The words of a class are reduced
+// together, so words reached from several of them are reduced once. Classes
+// are reduced by the jobs of context, each taking the next class not yet
+// taken; if stats is not NULL, stats[i] gets the statistics of class i.
+// Returns NI_OK, or NI_BAD_ARGUMENT if arguments are not valid.
+NI_API int ni_compute_classes(ni_context * context,
+			      const unsigned short * const * words,
+			      const int * sizes, int count, int ** NIs,
+			      int * class_sizes, ni_stats * stats);
+
+// Room in letters that ni_reduction needs for a word of size letters
+#define NI_REDUCTION_ROOM(size) ((size_t) ((size)/2)*(size_t) ((size)/2 + 1))
+
+// Writes a shortest reduction of word to the empty word: to path (room for
+// NI_REDUCTION_ROOM(size) letters) word and the relabeled word left by each
+// step but the last, one after another, to sizes (room for size/2) their
+// sizes and to steps (room for size/2) the step taken from each of them: 0
+// for the removal of its maximal subwords, else the letter removed. Returns
+// the nesting index of word, which is the number of steps, or an error as
+// ni_compute does. A word of odd size is not a DOW.
+NI_API int ni_reduction(ni_context * context, const unsigned short * word,
+			int size, unsigned short * path, int * sizes,
+			int * steps);
+
+// Writes to canonical (room for size letters, may be word) the canonical
+// word of the class of words cyclically equivalent to word. Returns the
+// number of words in class, or NI_NOT_DOW.
+NI_API int ni_canonical(const unsigned short * word, int size,
+			unsigned short * canonical);
+
+// Writes to isomorphisms (room for NI_ISOMORPHISMS_ROOM(size) letters) the
+// distinct relabeled rotations of word and of its reverse, one after another,
+// and returns their number.
+NI_API int ni_isomorphisms(const unsigned short * word, int size,
+			   unsigned short * isomorphisms);
+
+// Given a string of length chars (not necessarily null terminated), stores
+// its letters in word (room for length letters) and returns their number. If
+// string has punctuation, letters are the decimal numbers between the
+// delimiters ",-.!#$%&'*+/"; otherwise each char is a letter. Returns
+// NI_BAD_ARGUMENT if string has any other char than digits and delimiters.
+NI_API int ni_parse_word(const char * text, int length, unsigned short * word);
+
+// Stores the combined counts of the memo tables of context in counts.
+NI_API void ni_memo_stats(ni_context * context, ni_memo_counts * counts);
+
+// Returns a description of an error code.
+NI_API const char * ni_error_string(int code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif